@@ -1,7 +1,9 @@
 #pragma once
 
 #include "model/Model.h"
+#include "model/LoadOptions.h"
 #include "model/SkeletalAnim.h"
+#include "model/StagedModel.h"
 
 #include <SM_Matrix.h>
 
@@ -27,25 +29,35 @@ struct Material;
 class AssimpHelper
 {
 public:
-	static bool Load(const ur::Device& dev, Model& model, const std::string& filepath, float scale = 1.0f);
+	static bool Load(const ur::Device& dev, Model& model, const std::string& filepath, float scale = 1.0f,
+		const LoadOptions& opts = LoadOptions());
+	// CPU stage only, into staged.model, see StagedModel
+	static bool Load(StagedModel& staged, const std::string& filepath, float scale = 1.0f,
+		const LoadOptions& opts = LoadOptions());
     static bool Load(std::vector<std::unique_ptr<MeshRawData>>& meshes, const std::string& filepath);
 
     // config
     static void SetLoadRawData(bool load_raw_data) { m_load_raw_data = load_raw_data; }
 
 private:
+	static bool LoadScene(Model& model, StagedModel& staged, const std::string& filepath, float scale,
+		const LoadOptions& opts);
+
 	static int LoadNode(const aiScene* ai_scene, const aiNode* ai_node, Model& model,
 		std::vector<std::unique_ptr<SkeletalAnim::Node>>& nodes,
 		const std::vector<sm::cube>& meshes_aabb, const sm::mat4& mat);
 
-	static std::unique_ptr<Model::Mesh> LoadMesh(const ur::Device& dev,
+	static std::unique_ptr<Model::Mesh> LoadMesh(StagedModel::MeshBuffers& buffers,
         const std::vector<std::unique_ptr<Model::Material>>& materials, const aiMesh* ai_mesh, sm::cube& aabb);
 	static std::unique_ptr<MeshRawData> LoadMeshRawData(const aiMesh* ai_mesh);
 
 	static std::unique_ptr<Model::Material>
-        LoadMaterial(const ur::Device& dev, const aiMaterial* ai_material, Model& model, const std::string& dir);
+        LoadMaterial(const aiMaterial* ai_material, const std::string& dir, std::string& diffuse_path);
 
-	static int LoadTexture(const ur::Device& dev, Model& model, const std::string& filepath);
+	// decodes the diffuse_paths textures and sets materials' diffuse_tex,
+	// diffuse_paths[i] is of model.materials[i]
+	static void LoadTextures(StagedModel& staged, Model& model,
+		const std::vector<std::string>& diffuse_paths, bool decode, int max_threads);
 
 	static std::unique_ptr<SkeletalAnim::ModelExtend> LoadAnimation(const aiAnimation* ai_anim);
 	static std::unique_ptr<SkeletalAnim::NodeAnim> LoadNodeAnim(const aiNodeAnim* ai_node);
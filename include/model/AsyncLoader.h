@@ -0,0 +1,111 @@
+#pragma once
+
+#include "model/LoadOptions.h"
+
+#include <unirender/noncopyable.h>
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+
+namespace ur { class Device; }
+
+namespace model
+{
+
+struct Model;
+struct StagedModel;
+
+// Streams models in two stages: StagedModel::Load() (parsing, vertex packing,
+// texture decode) on worker threads, StagedModel::Upload() on the thread
+// that calls Upload(), which should own the device. Formats without a CPU
+// stage are not streamed, see IsStreamed().
+class AsyncLoader : ur::noncopyable
+{
+public:
+	typedef uint64_t Ticket;
+
+	// model is null if loading failed
+	typedef std::function<void(const std::shared_ptr<Model>& model)> Callback;
+
+public:
+	// thread_count <= 0 for one per hardware thread but the device's
+	AsyncLoader(int thread_count = 0);
+	~AsyncLoader();
+
+	// Higher priority first in both stages, FIFO within a priority. The
+	// callback runs in Upload(). The workers already spread loads over the
+	// cores, so an opts.import_threads <= 0 is taken as 1.
+	Ticket Load(const std::string& filepath, const Callback& cb, int priority = 0,
+		const LoadOptions& opts = LoadOptions());
+
+	// Drops a load not uploaded yet, its callback never runs. Return false
+	// for unknown or finished tickets.
+	bool Cancel(Ticket ticket);
+	// only reorders loads still waiting for a worker or the upload
+	bool SetPriority(Ticket ticket, int priority);
+
+	// Creates the device objects of up to max_count staged models and runs
+	// their callbacks, return the number uploaded.
+	size_t Upload(const ur::Device& dev, size_t max_count = std::numeric_limits<size_t>::max());
+
+	// loads not uploaded yet
+	size_t GetPendingCount() const;
+
+	// False for the formats StagedModel::IsDeferred() lists: they are queued
+	// the same way, but parsed whole in Upload() on the device's thread, as
+	// a synchronous load would.
+	static bool IsStreamed(const std::string& filepath);
+
+	int GetThreadCount() const { return static_cast<int>(m_workers.size()); }
+
+private:
+	enum class State
+	{
+		Queued,
+		Loading,
+		Staged,
+	};
+
+	struct Request
+	{
+		Ticket      ticket = 0;
+		std::string filepath;
+		LoadOptions opts;
+		Callback    cb;
+		int         priority = 0;
+
+		State state = State::Queued;
+		bool  cancelled = false;
+
+		std::unique_ptr<StagedModel> staged;
+	};
+
+	// ascending is highest priority first, then oldest
+	typedef std::pair<int, Ticket> Key;
+	static Key MakeKey(const Request& req) { return { -req.priority, req.ticket }; }
+
+	void WorkerLoop();
+
+private:
+	std::vector<std::thread> m_workers;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_quit = false;
+
+	Ticket m_next_ticket = 1;
+
+	std::map<Key, std::shared_ptr<Request>> m_queued, m_staged;
+	std::unordered_map<Ticket, std::shared_ptr<Request>> m_requests;
+
+}; // AsyncLoader
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <SM_Vector.h>
+#include <SM_Quaternion.h>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace model
+{
+
+// Samples every channel of one SkeletalAnim clip, see PackedClip and
+// CompressedClip. Immutable, so it can be shared by all instances.
+class ClipSampler
+{
+public:
+	// per channel key positions, owned by the caller (one set per instance)
+	struct Cursor
+	{
+		uint32_t pos = 0, rot = 0, scale = 0;
+	};
+
+public:
+	virtual ~ClipSampler() {}
+
+	// trans, rot, scale and cursors have GetNumChannels() elements. Channels
+	// with a 0 in channel_mask may be skipped and left as they were.
+	virtual void Sample(float time, Cursor* cursors, sm::vec3* trans,
+		sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask = nullptr) const = 0;
+
+	virtual int GetNumChannels() const = 0;
+
+	// channels Sample() leaves out under channel_mask
+	virtual int CountSkipped(const uint8_t* channel_mask) const
+	{
+		int n = 0;
+		for (int i = 0, m = channel_mask ? GetNumChannels() : 0; i < m; ++i) {
+			n += channel_mask[i] == 0;
+		}
+		return n;
+	}
+
+	virtual size_t GetMemSize() const = 0;
+
+}; // ClipSampler
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "model/ClipSampler.h"
+#include "model/SkeletalAnim.h"
+
+#include <vector>
+
+namespace model
+{
+
+// One SkeletalAnim clip with 16-bit keys: times as a fraction of the clip,
+// translations and scales range-quantized per track, rotations as
+// smallest-three quaternions. Sampled without expanding to floats first.
+class CompressedClip : public ClipSampler
+{
+public:
+	CompressedClip(const SkeletalAnim::ModelExtend& anim);
+
+	virtual void Sample(float time, Cursor* cursors, sm::vec3* trans,
+		sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask = nullptr) const override;
+
+	virtual int GetNumChannels() const override { return m_num_channels; }
+
+	virtual size_t GetMemSize() const override;
+
+private:
+	struct Track
+	{
+		uint32_t begin = 0, count = 0;
+
+		// value = min + q * step, unused by rotations
+		float min[3]  = { 0, 0, 0 };
+		float step[3] = { 0, 0, 0 };
+	};
+
+	// 3 uint16 per key
+	struct KeyPool
+	{
+		std::vector<uint16_t> time;
+		std::vector<uint16_t> value;
+	};
+
+	// key pair around qtime and the blend factor, false for empty tracks
+	bool FindKeys(const Track& track, const KeyPool& pool, float qtime,
+		uint32_t& cursor, uint32_t& k0, uint32_t& k1, float& factor) const;
+
+	void SampleVec3(const Track& track, const KeyPool& pool, float qtime,
+		uint32_t& cursor, sm::vec3& dst) const;
+	void SampleQuat(const Track& track, float qtime, uint32_t& cursor,
+		sm::Quaternion& dst) const;
+
+	void PushVec3Track(const std::vector<std::pair<float, sm::vec3>>& keys,
+		Track& track, KeyPool& pool);
+	void PushQuatTrack(const std::vector<std::pair<float, sm::Quaternion>>& keys,
+		Track& track);
+
+	uint16_t QuantizeTime(float time) const;
+
+private:
+	float m_duration = 0;
+
+	int m_num_channels = 0;
+
+	std::vector<Track> m_pos_tracks, m_rot_tracks, m_scale_tracks;
+
+	KeyPool m_pos_keys, m_rot_keys, m_scale_keys;
+
+}; // CompressedClip
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace ur { class Device; }
+
+namespace model
+{
+
+struct Model;
+struct StagedModel;
+
+// Versioned binary container of a processed model: meshes with the vertex
+// and 16 or 32 bit index blobs AssimpHelper and GltfLoader pack, materials,
+// texture paths relative to the source file and resolved next to the cooked
+// one, nodes, the SkeletalAnim skeleton and clip keys, and blendshape
+// deltas. Loading maps the file; vertex and index blobs go to the device
+// from the mapping and MeshGeometry::vert_buf keeps pointing into it.
+class CookedModel
+{
+public:
+	// From the CPU stage of any non-deferred StagedModel. False for clips
+	// SkeletalAnim::CompressAnims() quantized, their keys are released, and
+	// for textures without a file, e.g. images embedded in a glTF.
+	static bool Save(const StagedModel& staged, const std::string& filepath);
+
+	static bool Load(const ur::Device& dev, Model& model, const std::string& filepath);
+	// CPU stage, into staged.model
+	static bool Load(StagedModel& staged, const std::string& filepath);
+
+	static const uint32_t VERSION = 3;
+
+private:
+	static bool LoadModel(Model& model, StagedModel& staged, const std::string& filepath);
+
+}; // CookedModel
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <SM_Vector.h>
+#include <SM_Matrix.h>
+
+#include <cstddef>
+
+namespace model
+{
+
+struct MeshGeometry;
+class WorkerPool;
+
+// Linear blend skinning of MeshGeometry::vert_buf on the CPU, for hit tests
+// and baking without a device. Up to 4 bones per vertex as packed by the
+// loaders, weights renormalized to sum to 1.
+class CpuSkinning
+{
+public:
+	// palette holds one matrix per geometry bone, as ModelInstance::CalcBoneMatrices()
+	// or the mesh's range of a PaletteFormat::Mat4 ModelInstance::CalcPalettes().
+	// positions gets n_vert elements. normals can be null and is left untouched
+	// for meshes without normals. With a pool, meshes with more than
+	// vertices_per_task vertices are split over its threads.
+	static void Skin(const MeshGeometry& geo, const sm::mat4* palette,
+		sm::vec3* positions, sm::vec3* normals = nullptr, WorkerPool* pool = nullptr,
+		size_t vertices_per_task = 16384);
+
+	// vertices [begin, end) on the calling thread, outputs indexed by vertex
+	static void SkinRange(const MeshGeometry& geo, const sm::mat4* palette,
+		size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals = nullptr);
+
+	// kernel picked for this CPU: "avx2", "sse2" or "scalar"
+	static const char* GetKernelName();
+
+}; // CpuSkinning
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "model/StagedModel.h"
+
 #include <SM_Cube.h>
 
 #include <string>
@@ -14,23 +16,34 @@ namespace model
 {
 
 struct Model;
+struct MeshGeometry;
 namespace gltf { struct Model; struct Texture; struct Material; struct Mesh; struct Node; struct Scene; }
 
 class GltfLoader
 {
 public:
 	static bool Load(const ur::Device& dev, Model& model, const std::string& filepath);
+	// CPU stage only, into staged.model, see StagedModel
+	static bool Load(StagedModel& staged, const std::string& filepath);
 	static bool Load(const ur::Device& dev, gltf::Model& model, const std::string& filepath);
 
 private:
+	static bool ParseFile(tinygltf::Model& model, const std::string& filepath);
+	static bool LoadModel(Model& model, StagedModel& staged, const std::string& filepath);
+
+	static bool GetTextureFormat(const tinygltf::Image& img, ur::TextureFormat& format);
 	static std::shared_ptr<ur::Texture> LoadTexture(const ur::Device& dev, const tinygltf::Image& img);
+	// packs prim's vertices into geo.vert_buf and its indices into buffers
+	static void LoadPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& prim,
+		MeshGeometry& geo, StagedModel::MeshBuffers& buffers);
 	static std::shared_ptr<ur::VertexArray> LoadVertexArray(const ur::Device& dev, 
 		const tinygltf::Model& model, const tinygltf::Primitive& prim, unsigned int& vertex_type);
 
-	static void LoadTextures(const ur::Device& dev, Model& dst, const tinygltf::Model& src);
-	static void LoadMaterials(const ur::Device& dev, Model& dst, const tinygltf::Model& src);
-	static void LoadMeshes(const ur::Device& dev, Model& dst, const tinygltf::Model& src, sm::cube& aabb);
-	static void LoadNodes(const ur::Device& dev, Model& dst, const tinygltf::Model& src);
+	// moves the pixels out of src, file paths relative to dir
+	static void LoadTextures(StagedModel& staged, Model& dst, tinygltf::Model& src, const std::string& dir);
+	static void LoadMaterials(Model& dst, const tinygltf::Model& src);
+	static void LoadMeshes(StagedModel& staged, Model& dst, const tinygltf::Model& src);
+	static void LoadNodes(Model& dst, const tinygltf::Model& src);
 
 	static std::vector<std::shared_ptr<ur::TextureSampler>> LoadSamplers(
 		const ur::Device& dev, const tinygltf::Model& model
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "model/TimeContext.h"
+#include "model/WorkerPool.h"
+
+#include <unirender/noncopyable.h>
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace model
+{
+
+class ModelInstance;
+
+// Updates a batch of ModelInstances over a WorkerPool. Workers grab
+// fixed-size chunks from a shared atomic counter, so the only locking is
+// once per worker at the start and end of each batch.
+class InstanceUpdater : ur::noncopyable
+{
+public:
+	// own pool, thread_count <= 0 for one per hardware thread, the calling thread included
+	InstanceUpdater(int thread_count = 0);
+	// on a pool shared with e.g. CpuSkinning::Skin(), which must outlive the updater
+	InstanceUpdater(WorkerPool& pool);
+	~InstanceUpdater();
+
+	// Instances must be distinct; each one is updated by a single thread. The
+	// optional callback runs right after the instance's update on the same
+	// thread, e.g. to build its bone palettes.
+	void UpdateInstances(ModelInstance* const* instances, size_t count, const TimeContext& ctx,
+		const std::function<void(ModelInstance&)>& post_update = nullptr);
+	void UpdateInstances(const std::vector<ModelInstance*>& instances, const TimeContext& ctx,
+		const std::function<void(ModelInstance&)>& post_update = nullptr);
+	// TimeContext at speed 1
+	void UpdateInstances(const std::vector<ModelInstance*>& instances, float time,
+		const std::function<void(ModelInstance&)>& post_update = nullptr);
+
+	int GetThreadCount() const;
+
+private:
+	std::unique_ptr<WorkerPool> m_own_pool = nullptr;
+	WorkerPool* m_pool = nullptr;
+
+}; // InstanceUpdater
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace model
+{
+
+// Settings of one StagedModel::Load(), passed down to the loaders instead of
+// global config, so concurrent loads don't share state.
+struct LoadOptions
+{
+	// run SkeletalAnim::OptimizeAnims() on the clips, off by default as it
+	// drops channels of nodes nothing in the file depends on
+	bool optimize_anims = false;
+	// nodes to keep animated besides skinned bones and mesh nodes, e.g. attachment points
+	std::vector<std::string> anim_keep_nodes;
+
+	// resample clips onto a uniform grid where SkeletalAnim::ResampleAnims() accepts it
+	bool resample_anims = false;
+
+	// off to only record texture paths, e.g. when cooking
+	bool decode_textures = true;
+
+	// threads converting one scene's meshes, clips and textures, <= 0 for one
+	// per core; scenes too small to gain stay on the calling thread. Keep it
+	// at 1 when the loads themselves are already spread over the cores.
+	int import_threads = 0;
+
+}; // LoadOptions
+
+}
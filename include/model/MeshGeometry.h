@@ -1,6 +1,7 @@
 #pragma once
 
 #include <SM_Matrix.h>
+#include <SM_Cube.h>
 #include <unirender/noncopyable.h>
 
 #include <unordered_map>
@@ -31,6 +32,10 @@ struct Bone
 	int node = -1;
 	std::string name;
 	sm::mat4 offset_trans;
+
+	// vertices with a weight on this bone, in bone space (offset_trans
+	// applied), empty if none
+	sm::cube bound;
 };
 
 struct MeshRawData
@@ -82,6 +87,9 @@ struct MeshGeometry : ur::noncopyable
 	// skeletal anim
 	std::vector<Bone> bones;
 
+	// bind pose, in mesh space
+	sm::cube aabb;
+
 	//// morph anim
 	//std::vector<ur::VertexAttrib> vertex_layout;
 
@@ -92,6 +100,9 @@ struct MeshGeometry : ur::noncopyable
     size_t n_vert = 0, n_poly = 0;
     const uint8_t* vert_buf = nullptr;
     size_t vert_stride = 0;
+    // keeps vert_buf alive when it points into shared memory, e.g. a mapped
+    // cooked file, otherwise vert_buf is owned
+    std::shared_ptr<const void> vert_buf_storage = nullptr;
     std::vector<std::unique_ptr<BlendShapeData>> blendshape_data;
 
 	unsigned int vertex_type = 0;
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "model/SkeletalAnim.h"
+#include "model/ClipSampler.h"
+#include "model/MorphTargetAnim.h"
+#include "model/TimeContext.h"
+#include "model/PoseBuffer.h"
+
 #include <SM_Matrix.h>
+#include <SM_Cube.h>
 #include <unirender/noncopyable.h>
 
 #include <vector>
 #include <memory>
-#include <tuple>
 
 namespace model{
 
@@ -14,24 +20,130 @@ class ModelExtend;
 
 class ModelInstance : ur::noncopyable
 {
+public:
+	enum class BlendMode
+	{
+		Override,
+		// added on top, relative to the clip's first frame
+		Additive,
+	};
+
+	enum class LoopMode
+	{
+		Loop,
+		// hold the last frame
+		Once,
+		PingPong,
+	};
+
+	enum class LodBlend
+	{
+		// keep the last evaluated pose
+		Hold,
+		// between the last two evaluated poses, one interval late
+		Interpolate,
+		// past the last evaluated pose
+		Extrapolate,
+	};
+
+	struct AnimLod
+	{
+		// 0 evaluates all bones, tier n leaves nodes less than n levels above
+		// a leaf at the bind pose, up to SkeletalAnim::MAX_LOD_TIER
+		int tier = 0;
+
+		// full evaluation once every update_interval updates, staggered by phase
+		int update_interval = 1;
+		int phase = 0;
+
+		LodBlend blend = LodBlend::Interpolate;
+	};
+
+	struct AnimLodStats
+	{
+		int updates = 0;
+		int full_updates = 0;
+
+		int channels_sampled = 0;
+		int channels_skipped = 0;
+		int nodes_skipped = 0;
+	};
+
+	enum class PaletteFormat
+	{
+		// column major 4x4, as sm::mat4
+		Mat4,
+		// row major 3x4, the last row dropped
+		Mat3x4,
+	};
+
 public:
 	ModelInstance(const std::shared_ptr<Model>& model, int anim_idx = 0);
     ~ModelInstance();
 
+	// time from GlobalClock
 	bool Update();
+	bool Update(float time);
+	bool Update(const TimeContext& ctx);
 	bool SetFrame(int frame);
 
+	// Playback state, per instance. Clips run on a local clock that Update()
+	// advances by the elapsed time times the speed, so speed changes don't
+	// jump. SetStartTime() takes Update()'s time, converted at the play speed;
+	// without it the first Update() starts the clip. GetStartTime() is on the
+	// local clock. Speed is on top of Model::anim_speed.
+	void  SetStartTime(float time);
+	void  ResetStartTime() { m_started = false; }
+	float GetStartTime() const { return m_start_time; }
+	void  SetPlaySpeed(float speed) { m_play_speed = speed; }
+	float GetPlaySpeed() const { return m_play_speed; }
+	void     SetLoopMode(LoopMode mode) { m_loop_mode = mode; }
+	LoopMode GetLoopMode() const { return m_loop_mode; }
+
 	const std::vector<sm::mat4>& CalcBoneMatrices(int node, int mesh) const;
 
+	// Skinning palettes of every skinned mesh in one pass, each mesh posed by
+	// the first node that references it. dst holds GetPaletteSize() matrices
+	// in the given format, mesh i starting at GetPaletteOffset(i). Caches the
+	// mesh nodes' inverse, on the updating thread only.
+	void CalcPalettes(float* dst, PaletteFormat fmt = PaletteFormat::Mat4);
+	// from a published pose, safe on the reader thread while the instance updates
+	void CalcPalettes(const PoseSnapshot& pose, float* dst, PaletteFormat fmt = PaletteFormat::Mat4) const;
+	size_t GetPaletteSize() const { return m_palette_remap.size(); }
+	// in matrices, -1 for meshes without bones or node
+	int    GetPaletteOffset(int mesh) const {
+		return mesh >= 0 && mesh < static_cast<int>(m_palette_offsets.size()) ? m_palette_offsets[mesh] : -1;
+	}
+
+	// Hands the global trans to one reader thread without locks, see
+	// PoseBuffer. PublishPose() runs on the updating thread, with auto publish
+	// every Update() that changes the pose calls it. AcquirePose() runs on
+	// the reader thread, the snapshot stays valid until its next call.
+	void PublishPose();
+	void SetAutoPublishPose(bool publish) { m_auto_publish = publish; }
+	bool GetAutoPublishPose() const { return m_auto_publish; }
+	const PoseSnapshot* AcquirePose() { return m_pose_buffer.Acquire(); }
+
+	// Posed bounds in Model::aabb's space, from the per-bone bounds and the
+	// current global trans, O(bones). Model::aabb for non-skeletal models.
+	sm::cube CalcPosedAABB() const;
+
 	const std::shared_ptr<Model>& GetModel() const { return m_model; }
 
+	// current frame of a MorphTargetAnim model
+	auto& GetMorphState() const { return m_morph_state; }
+
 	int  GetCurrAnimIndex() const { return m_curr_anim_index; }
-	void SetCurrAnimIndex(int idx) { m_curr_anim_index = idx; }
+	void SetCurrAnimIndex(int idx);
 
-	auto& GetLocalTrans() const { return m_local_trans; }
+	// composed from the local pose into the instance's buffer on each call
+	const std::vector<sm::mat4>& GetLocalTrans();
+	auto& GetLocalPose() const { return m_local_pose; }
 	auto& GetGlobalTrans() const { return m_global_trans; }
 
+	// shear is dropped
 	void SetLocalTrans(const std::vector<sm::mat4>& local_trans);
+	void SetLocalPose(const SkeletalAnim::Pose& local_pose);
 
 	void RotateJoint(int idx, const sm::Quaternion& delta);
 	void TranslateJoint(int idx, const sm::vec3& offset);
@@ -43,33 +155,166 @@ public:
 
 	void ResetToTPose();
 
+	// fade the current clip into anim_idx, fade_time in Update()'s time unit.
+	// Called during a fade, the blend so far is frozen and fades out instead.
+	void CrossFade(int anim_idx, float fade_time);
+
+	// Layers are blended over the current clip in order. node_mask holds one
+	// weight per skeleton node and can be null. Blending happens in Update().
+	// AddLayer() returns an id that stays valid until the layer is removed,
+	// -1 on failure; unknown ids are ignored.
+	int  AddLayer(int anim_idx, BlendMode mode, float weight = 1.0f,
+		const std::shared_ptr<const std::vector<float>>& node_mask = nullptr);
+	void SetLayerWeight(int layer_id, float weight);
+	void RemoveLayer(int layer_id);
+	void ClearLayers() { m_layers.clear(); }
+	int  GetLayerCount() const { return static_cast<int>(m_layers.size()); }
+
+	// single clip playback only, blending evaluates the full skeleton
+	void  SetAnimLod(const AnimLod& lod);
+	auto& GetAnimLod() const { return m_lod; }
+	auto& GetAnimLodStats() const { return m_lod_stats; }
+	void  ResetAnimLodStats() { m_lod_stats = AnimLodStats(); }
+
+	// play from the clips' PoseCache when baked, in model space the
+	// local trans are left untouched
+	void SetUsePoseCache(bool use) { m_use_pose_cache = use; }
+	bool GetUsePoseCache() const { return m_use_pose_cache; }
+
     void SetModelExt(std::unique_ptr<ModelExtend>& ext);
     auto& GetModelExt() const { return m_ext; }
     auto& GetModelExt() { return m_ext; }
 
 private:
-	bool UpdateMorphTargetAnim();
-	bool UpdateSkeletalAnim();
+	bool UpdateMorphTargetAnim(float curr_time);
+	bool UpdateSkeletalAnim(float curr_time);
+
+	// pose between LOD updates, return false if unchanged
+	bool UpdateLodPose(float curr_time);
+
+	// local time since start, wrapped by the loop mode
+	float CalcClipTime(float elapsed, float duration) const;
+
+	// return true if it wrote the global trans too
+	bool SampleAnim(const SkeletalAnim::ModelExtend& anim, float time);
 
-	void CalcGlobalTrans();
+	void BlendAnims(float curr_time);
+	// the cross-faded base clip into m_local_pose, before the layers
+	void BlendBase(float curr_time);
+	void SampleClip(const SkeletalAnim::ModelExtend& anim, float start_time,
+		ClipSampler::Cursor* cursors, float curr_time);
+	void BlendOverride(const SkeletalAnim::ModelExtend& anim, float weight,
+		const std::vector<float>* node_mask);
+	void BlendAdditive(const SkeletalAnim::ModelExtend& anim, const SkeletalAnim::Pose& ref,
+		float weight, const std::vector<float>* node_mask);
+
+	const SkeletalAnim::ModelExtend* GetAnim(int idx) const;
+	const SkeletalAnim::ModelExtend* GetCurrAnim() const { return GetAnim(m_curr_anim_index); }
+
+private:
+	struct AnimSource
+	{
+		int   anim = -1;
+		float start_time = 0;
+		std::vector<ClipSampler::Cursor> cursors;
+	};
+
+	struct AnimLayer
+	{
+		int        id = -1;
+		AnimSource src;
+		BlendMode  mode = BlendMode::Override;
+		float      weight = 1.0f;
+		std::shared_ptr<const std::vector<float>> node_mask = nullptr;
+
+		// additive reference, per channel
+		SkeletalAnim::Pose ref;
+	};
+
+	// root < 0 for all nodes, otherwise only the subtree under root
+	void CalcGlobalTrans(int root = -1);
+
+	void InitPaletteLayout();
+	void InitNodeBounds();
+	void UpdateMeshNodeInv();
+	void CalcPalettes(const sm::mat4* global_trans, const sm::mat4* mesh_node_inv,
+		sm::mat4* bone_trans, float* dst, PaletteFormat fmt) const;
 
 private:
 	std::shared_ptr<Model> m_model = nullptr;
 
 	int m_curr_anim_index = -1;
 
-	std::vector<sm::mat4> m_local_trans;
+	SkeletalAnim::Pose    m_local_pose;
 	std::vector<sm::mat4> m_global_trans;
 
-	std::vector<int> m_channel_idx;
+	std::vector<sm::mat4> m_local_trans;
 
-	float m_last_time = 0;
+	// local clock of the last Update() and the clip's start on it
+	float m_curr_time = 0;
 	float m_start_time = 0;
+	bool  m_started = false;
+	// Update()'s time of the last call
+	float m_last_time = 0;
 
-	std::vector<std::tuple<unsigned int, unsigned int, unsigned int> > m_last_pos;
+	float    m_play_speed = 1.0f;
+	LoopMode m_loop_mode = LoopMode::Loop;
+
+	std::vector<ClipSampler::Cursor> m_cursors;
+
+	// sampled channels, kept across updates so steady state doesn't allocate
+	std::vector<sm::vec3>       m_channel_trans;
+	std::vector<sm::Quaternion> m_channel_rot;
+	std::vector<sm::vec3>       m_channel_scale;
+
+	bool m_use_pose_cache = false;
+
+	// base clip fading out, or a frozen pose of an interrupted fade
+	AnimSource m_fade_from;
+	SkeletalAnim::Pose m_fade_pose;
+	bool  m_fade_frozen = false;
+	float m_fade_start = 0, m_fade_time = 0;
+
+	std::vector<AnimLayer> m_layers;
+	int m_next_layer_id = 0;
+
+	MorphTargetAnim::State m_morph_state;
+
+	AnimLod      m_lod;
+	AnimLodStats m_lod_stats;
+	int m_lod_frame = 0;
+	// the last two evaluated poses
+	SkeletalAnim::Pose m_lod_prev, m_lod_curr;
+	float m_lod_prev_time = 0, m_lod_curr_time = 0;
+	bool  m_lod_has_prev = false;
 
 	mutable std::vector<sm::mat4> m_bone_trans;
 
+	// palette layout, bones with the same node, offset and mesh node are shared
+	struct PaletteBone
+	{
+		int node = -1;
+		int mesh_node = 0;    // into m_mesh_nodes
+		sm::mat4 offset_trans;
+	};
+	std::vector<PaletteBone> m_palette_bones;
+	std::vector<int>         m_palette_remap;    // palette entry -> bone, -1 for identity
+	std::vector<int>         m_palette_offsets;  // per mesh
+	std::vector<int>         m_mesh_nodes;
+
+	// mesh node global trans and their inverse, only inverted again when moved
+	std::vector<sm::mat4> m_mesh_node_trans;
+	std::vector<sm::mat4> m_mesh_node_inv;
+	std::vector<sm::mat4> m_palette_bone_trans;
+
+	// node local bounds, of the bones' vertices and the rigid meshes
+	std::vector<std::pair<int, sm::cube>> m_node_bounds;
+	// meshes without a posed bound, at the bind pose
+	sm::cube m_static_bound;
+
+	PoseBuffer m_pose_buffer;
+	bool m_auto_publish = false;
+
     std::unique_ptr<ModelExtend> m_ext = nullptr;
 
 }; // ModelInstance
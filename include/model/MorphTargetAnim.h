@@ -5,8 +5,19 @@
 namespace model
 {
 
+// Shared by all instances and immutable after loading, the playback
+// state lives in each ModelInstance.
 class MorphTargetAnim : public ModelExtend
 {
+public:
+	struct State
+	{
+		int   frame = 0;
+		// to the next frame
+		float blend = 0;
+
+	}; // State
+
 public:
 	MorphTargetAnim(int fps, int num_frames, int num_vertices);
 
@@ -19,11 +30,10 @@ public:
 	int GetNumFrames() const { return m_num_frames; }
 	int GetNumVertices() const { return m_num_vertices; }
 
-	void SetFrame(int frame) { m_frame = frame; }
-	int  GetFrame() const { return m_frame; }
+	float GetDuration() const { return static_cast<float>(m_num_frames) / m_fps; }
 
-	void  SetBlend(float blend) { m_blend = blend; }
-	float GetBlend() const { return m_blend; }
+	// time in [0, GetDuration()]
+	State CalcState(float time) const;
 
 private:
 	int m_fps = 30;
@@ -31,9 +41,6 @@ private:
 	int m_num_frames = 0;
 	int m_num_vertices = 0;
 
-	int m_frame = 0;
-	float m_blend = 0;
-
 }; // MorphTargetAnim
 
 }
\ No newline at end of file
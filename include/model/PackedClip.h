@@ -0,0 +1,74 @@
+#pragma once
+
+#include "model/ClipSampler.h"
+#include "model/SkeletalAnim.h"
+
+#include <vector>
+
+namespace model
+{
+
+// All channels' keys of one SkeletalAnim clip in contiguous SoA arrays,
+// sampled 4 channels at a time.
+class PackedClip : public ClipSampler
+{
+public:
+	PackedClip(const SkeletalAnim::ModelExtend& anim);
+
+	virtual void Sample(float time, Cursor* cursors, sm::vec3* trans,
+		sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask = nullptr) const override;
+
+	virtual int GetNumChannels() const override { return m_num_channels; }
+
+	virtual int CountSkipped(const uint8_t* channel_mask) const override;
+
+	virtual size_t GetMemSize() const override;
+
+private:
+	struct Track
+	{
+		uint32_t begin = 0, count = 0;
+	};
+
+	struct Vec3Keys
+	{
+		std::vector<float> time, x, y, z;
+
+		void Push(float t, const sm::vec3& v);
+	};
+
+	struct QuatKeys
+	{
+		std::vector<float> time, x, y, z, w;
+
+		void Push(float t, const sm::Quaternion& q);
+	};
+
+	// key indices and blend factor for 4 channels
+	struct Lanes
+	{
+		uint32_t k0[4], k1[4];
+		float    factor[4];
+	};
+
+	void FindKeys(const Track* tracks, const std::vector<float>& times, float time,
+		int begin, int num, uint32_t Cursor::* field, Cursor* cursors, Lanes& lanes) const;
+
+	void LerpVec3(const Vec3Keys& keys, const Lanes& lanes, int num, sm::vec3* dst) const;
+	void NlerpQuat(const Lanes& lanes, int num, sm::Quaternion* dst) const;
+
+private:
+	float m_duration = 0;
+
+	int m_num_channels = 0;
+
+	// one per channel, padded to a multiple of 4 with empty tracks
+	std::vector<Track> m_pos_tracks, m_rot_tracks, m_scale_tracks;
+
+	// key 0 of each pool is the default value used by empty tracks
+	Vec3Keys m_pos_keys, m_scale_keys;
+	QuatKeys m_rot_keys;
+
+}; // PackedClip
+
+}
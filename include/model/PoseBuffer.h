@@ -0,0 +1,65 @@
+#pragma once
+
+#include <SM_Matrix.h>
+#include <unirender/noncopyable.h>
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+namespace model
+{
+
+// One published pose of a ModelInstance.
+struct PoseSnapshot
+{
+	std::vector<sm::mat4> global_trans;
+	// inverse global trans of the skinned meshes' nodes, for palettes
+	std::vector<sm::mat4> mesh_node_inv;
+
+	// instance local clock of the Update() that produced it
+	float    time = 0;
+	// 1 for the first published pose
+	uint64_t version = 0;
+
+	// reader side scratch of ModelInstance::CalcPalettes()
+	mutable std::vector<sm::mat4> palette_bones;
+
+}; // PoseSnapshot
+
+// Triple buffer between one writer and one reader thread, no locks. The
+// writer fills GetBack() and publishes it, the reader takes the newest
+// published slot, which stays untouched until its next Acquire(). Slots
+// keep their capacity, so steady state doesn't allocate.
+class PoseBuffer : ur::noncopyable
+{
+public:
+	PoseBuffer();
+
+	// writer side
+	PoseSnapshot& GetBack() { return m_slots[m_back]; }
+	void Publish();
+
+	// reader side, nullptr before the first Publish()
+	const PoseSnapshot* Acquire();
+
+private:
+	// set on m_middle while it holds a pose not yet acquired
+	static const uint32_t FRESH_BIT = 4;
+
+	PoseSnapshot m_slots[3];
+
+	// owned by the writer
+	uint32_t m_back = 0;
+	uint64_t m_version = 0;
+
+	// slot index | FRESH_BIT, swapped by both sides
+	std::atomic<uint32_t> m_middle;
+
+	// owned by the reader
+	uint32_t m_front = 2;
+	bool     m_has_front = false;
+
+}; // PoseBuffer
+
+}
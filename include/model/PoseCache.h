@@ -0,0 +1,69 @@
+#pragma once
+
+#include "model/SkeletalAnim.h"
+
+#include <SM_Vector.h>
+#include <SM_Quaternion.h>
+#include <SM_Matrix.h>
+
+#include <vector>
+#include <cstdint>
+
+namespace model
+{
+
+// One SkeletalAnim clip sampled at GetMaxFrameCount() evenly spaced frames,
+// played back with a frame lookup and a lerp, no key search.
+class PoseCache
+{
+public:
+	enum class Space
+	{
+		// channel TRS, still needs the hierarchy pass
+		Local,
+		// node global matrices, replaces the hierarchy pass
+		Model,
+	};
+
+public:
+	// quantize only applies to Space::Local
+	PoseCache(const SkeletalAnim& sk_anim, const SkeletalAnim::ModelExtend& anim,
+		Space space, bool quantize);
+
+	// Space::Local, arrays have GetNumItems() (clip channels) elements
+	void Sample(float time, sm::vec3* trans, sm::Quaternion* rot, sm::vec3* scale) const;
+	// Space::Model, array has GetNumItems() (skeleton nodes) elements
+	void Sample(float time, sm::mat4* global_trans) const;
+
+	Space GetSpace() const { return m_space; }
+	bool  IsQuantized() const { return !m_qdata.empty(); }
+
+	int GetNumFrames() const { return m_num_frames; }
+	int GetNumItems() const { return m_num_items; }
+
+	size_t GetMemSize() const;
+
+private:
+	void CalcFrame(float time, int& frame, float& factor) const;
+
+	void Quantize();
+
+private:
+	Space m_space = Space::Local;
+
+	float m_duration = 0;
+
+	int m_num_frames = 0;
+	int m_num_items  = 0;
+
+	// frame major, per item: t3 r4 s3 (local) or a 3x4 matrix (model)
+	std::vector<float> m_data;
+
+	// quantized local poses, same layout as m_data
+	std::vector<int16_t> m_qdata;
+	// per item: t min3 ext3, s min3 ext3
+	std::vector<float>   m_qrange;
+
+}; // PoseCache
+
+}
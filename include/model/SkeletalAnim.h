@@ -6,6 +6,7 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <memory>
 
 #include <math.h>
@@ -13,6 +14,9 @@
 namespace model
 {
 
+class ClipSampler;
+class PoseCache;
+
 class SkeletalAnim : public ModelExtend
 {
 public:
@@ -41,6 +45,22 @@ public:
 
 	}; // NodeAnim
 
+	// local transforms split into translation, rotation and scale
+	struct Pose
+	{
+		std::vector<sm::vec3>       trans;
+		std::vector<sm::Quaternion> rot;
+		std::vector<sm::vec3>       scale;
+
+		void Resize(size_t n) {
+			trans.resize(n);
+			rot.resize(n);
+			scale.resize(n);
+		}
+		size_t Size() const { return trans.size(); }
+
+	}; // Pose
+
 	struct ModelExtend
 	{
 		std::string name;
@@ -49,17 +69,24 @@ public:
 
 		float ticks_per_second = 0;
 
-		std::vector<std::unique_ptr<NodeAnim>> channels;
+		// keys are immutable once loaded, shared by copies of the clip
+		std::vector<std::shared_ptr<const NodeAnim>> channels;
+
+		// node idx -> channel idx, -1 for no channel, filled by SkeletalAnim
+		std::vector<int> node_to_channel;
 
-        ModelExtend() {}
-        ModelExtend(const SkeletalAnim::ModelExtend& m)
-            : name(m.name), duration(m.duration), ticks_per_second(m.ticks_per_second)
-        {
-            channels.reserve(m.channels.size());
-            for (auto& c : m.channels) {
-                channels.push_back(std::move(std::make_unique<NodeAnim>()));
-            }
-        }
+		// channels in a form made for sampling, PackedClip or CompressedClip
+		std::shared_ptr<const ClipSampler> sampler = nullptr;
+
+		// [tier - 1][channel], 0 for channels skipped at that LOD tier
+		std::vector<std::vector<uint8_t>> lod_channel_mask;
+
+		// optional, see SkeletalAnim::BakePoseCaches()
+		std::shared_ptr<const PoseCache> pose_cache = nullptr;
+
+		const uint8_t* GetLodChannelMask(int tier) const {
+			return tier > 0 && tier <= static_cast<int>(lod_channel_mask.size()) ? lod_channel_mask[tier - 1].data() : nullptr;
+		}
 
 		int GetMaxFrameCount() const {
 			return static_cast<int>(roundf(duration * ticks_per_second)) + 1;
@@ -67,30 +94,148 @@ public:
 
 	}; // ModelExtend
 
+	// clips are shared by clones, changing one means replacing it with a copy
+	typedef std::vector<std::shared_ptr<const ModelExtend>> AnimList;
+
+	struct OptimizeStats
+	{
+		// before the pass, over all clips
+		int num_channels = 0;
+
+		// constant and equal to the bind pose in every clip
+		int folded = 0;
+		// driving no kept node
+		int unused = 0;
+
+		// repeated keys dropped from constant tracks
+		int keys_removed = 0;
+
+	}; // OptimizeStats
+
+	struct CompressParams
+	{
+		// max error in bone space: distance for translation, distance moved
+		// by the bone's tip for rotation, absolute for scale
+		float pos_tolerance   = 0.001f;
+		float rot_tolerance   = 0.001f;
+		float scale_tolerance = 0.001f;
+
+		// for bones without children, turns rotation error into a distance
+		float leaf_bone_length = 1.0f;
+
+		// drop keys interpolation reproduces within the tolerances
+		bool reduce_keys = true;
+		// 16-bit keys in a CompressedClip, the float keys are released
+		bool quantize = true;
+
+	}; // CompressParams
+
+	struct ResampleParams
+	{
+		// max difference to the keyed clip between grid frames, in
+		// translation/scale units and rotation chord length
+		float tolerance = 0.001f;
+
+		// grid memory allowed, relative to the clip's current sampler
+		float max_mem_ratio = 1.5f;
+
+	}; // ResampleParams
+
+	// LOD tier n skips the nodes less than n levels above a leaf
+	static const int MAX_LOD_TIER = 3;
+
 public:
 	virtual ModelExtendType Type() const override { return EXT_SKELETAL; }
 
     virtual std::unique_ptr<model::ModelExtend> Clone() const override;
 
 	void  SetAnims(std::vector<std::unique_ptr<ModelExtend>>& anims);
-	auto& GetAnims() const { return m_anims; }
+	const AnimList& GetAnims() const { return *m_anims; }
 
 	void  SetNodes(std::vector<std::unique_ptr<Node>>& nodes);
-	auto& GetNodes() const { return m_nodes; }
+	auto& GetNodes() const { return m_skeleton->nodes; }
+
+	int QueryNodeByName(const std::string& name) const;
+
+	auto& GetTPWorldTrans() const { return m_skeleton->tpose_world_trans; }
+
+	// nodes' local_trans as TRS
+	auto& GetBindPose() const { return m_skeleton->bind_pose; }
+
+	// parent-before-child, depth-first, so each subtree is a contiguous range
+	auto& GetEvalOrder() const { return m_skeleton->eval_order; }
+
+	// levels to the deepest leaf below, 0 for leaves
+	auto& GetNodeHeights() const { return m_skeleton->node_height; }
+
+	// root < 0 for the whole hierarchy, otherwise only root and its descendants
+	void CalcGlobalTrans(const std::vector<sm::mat4>& local_trans,
+		std::vector<sm::mat4>& global_trans, int root = -1) const;
+	// local matrices are composed on the fly
+	void CalcGlobalTrans(const Pose& local_pose,
+		std::vector<sm::mat4>& global_trans, int root = -1) const;
+
+	// Load time pass over all clips, before BakePoseCaches(). Drops channels
+	// that drive none of keep_nodes or their ancestors, shrinks constant
+	// tracks to one key, and drops channels whose node stays at the bind pose.
+	OptimizeStats OptimizeAnims(const std::vector<int>& keep_nodes);
 
-	auto& GetTPWorldTrans() const { return m_tpose_world_trans; }
+	// Lossy, after OptimizeAnims() and before BakePoseCaches(). With quantize
+	// the clips keep only channel names. OptimizeAnims() and another
+	// CompressAnims() need the keys and leave such clips as they are;
+	// ResampleAnims() and BakePoseCaches() sample the CompressedClip.
+	void   CompressAnims(const CompressParams& params);
+	// Switch clips to a UniformClip where it is accurate and small enough,
+	// return the number switched. Others keep their keyed sampler.
+	int    ResampleAnims(const ResampleParams& params);
+
+	// keys and samplers of all clips, pose caches excluded
+	size_t GetAnimMemSize() const;
+
+	// sample every clip at its GetMaxFrameCount() rate, shared by all instances
+	void   BakePoseCaches(bool model_space, bool quantize);
+	size_t GetPoseCacheMemSize() const;
 
 	void PrintNodeTree() const;
 
-private:
-	void InitTPoseTrans();
+	static sm::mat4 ComposeTrans(const sm::vec3& trans,
+		const sm::Quaternion& rot, const sm::vec3& scale);
+	// inverse of ComposeTrans(), no shear
+	static void DecomposeTrans(const sm::mat4& mat, sm::vec3& trans,
+		sm::Quaternion& rot, sm::vec3& scale);
 
 private:
-	std::vector<std::unique_ptr<Node>> m_nodes;
+	// immutable once built, shared by clones
+	struct Skeleton
+	{
+		std::vector<std::unique_ptr<Node>> nodes;
+		std::unordered_map<std::string, int> name2node;
+
+		std::vector<int> eval_order;
+		std::vector<int> eval_parent;
+		// node -> [begin, end) in eval_order
+		std::vector<std::pair<int, int>> subtree_range;
+
+		std::vector<int> node_height;
 
-	std::vector<sm::mat4> m_tpose_world_trans;
+		std::vector<sm::mat4> tpose_world_trans;
 
-	std::vector<std::unique_ptr<ModelExtend>> m_anims;
+		Pose bind_pose;
+
+	}; // Skeleton
+
+	static void InitEvalOrder(Skeleton& sk);
+	void InitTPoseTrans(Skeleton& sk) const;
+
+	// copies of the clips with node_to_channel and the LOD masks set for the
+	// current skeleton
+	std::shared_ptr<const AnimList> BindChannels(const AnimList& anims) const;
+	// channels kept at higher LOD tiers first, so each tier masks a tail
+	void SortChannelsByLod(ModelExtend& anim) const;
+
+private:
+	std::shared_ptr<const Skeleton> m_skeleton = std::make_shared<Skeleton>();
+	std::shared_ptr<const AnimList> m_anims = std::make_shared<AnimList>();
 
 }; // SkeletalAnim
 
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "model/Model.h"
+#include "model/LoadOptions.h"
+#include "model/SkeletalAnim.h"
+#include "model/TextureLoader.h"
+
+#include <unirender/noncopyable.h>
+
+#include <vector>
+#include <memory>
+#include <string>
+
+namespace ur { class Device; class VertexArray; class VertexInputAttribute; }
+
+namespace model
+{
+
+// Output of a model's CPU load stage: parsed, packed and decoded, without
+// device objects. Load() runs on any thread, Upload() on the thread that
+// owns the device.
+struct StagedModel : ur::noncopyable
+{
+	// vertex array of Model::meshes[mesh], vertices from MeshGeometry::vert_buf
+	struct MeshBuffers
+	{
+		int mesh = -1;
+
+		std::vector<uint16_t> indices;
+		// 32 bit, used instead of indices if not empty, e.g. glTF
+		std::vector<uint32_t> indices32;
+		// used instead of both if set, owned by the model, e.g. a mapped file
+		const uint16_t* index_data = nullptr;
+		const uint32_t* index_data32 = nullptr;
+		size_t index_count = 0;
+
+		std::vector<std::shared_ptr<ur::VertexInputAttribute>> attrs;
+
+		bool HasIndices32() const { return index_data32 || (!index_data && !indices32.empty()); }
+		const void* GetIndexData() const;
+		size_t GetIndexCount() const;
+		size_t GetIndexBytes() const {
+			return GetIndexCount() * (HasIndices32() ? sizeof(uint32_t) : sizeof(uint16_t));
+		}
+	};
+
+	// pixels of Model::textures[tex]
+	struct Texture
+	{
+		int tex = -1;
+
+		TextureLoader::Image image;
+	};
+
+	// what UploadResources() creates and copies, without a device
+	struct UploadStats
+	{
+		int vertex_arrays  = 0;
+		int vertex_buffers = 0;
+		int index_buffers  = 0;
+		int textures       = 0;
+
+		size_t vertex_bytes  = 0;
+		size_t index_bytes   = 0;
+		size_t texture_bytes = 0;
+
+		size_t GetTotalBytes() const { return vertex_bytes + index_bytes + texture_bytes; }
+	};
+
+	std::string filepath;
+
+	// dev stays null until Upload()
+	std::unique_ptr<Model> model = nullptr;
+
+	std::vector<MeshBuffers> meshes;
+	std::vector<Texture>     textures;
+
+	// formats without a separate CPU stage are loaded whole in Upload(), see
+	// IsDeferred()
+	bool deferred = false;
+
+	// channels SkeletalAnim::OptimizeAnims() removed during Load(), with
+	// LoadOptions::optimize_anims
+	SkeletalAnim::OptimizeStats anim_opt_stats;
+	// LoadOptions::anim_keep_nodes missing from the skeleton
+	std::vector<std::string> unknown_keep_nodes;
+
+	// null on failure
+	static std::unique_ptr<StagedModel> Load(const std::string& filepath,
+		const LoadOptions& opts = LoadOptions());
+
+	// consumes the staged data, null on failure
+	std::shared_ptr<Model> Upload(const ur::Device& dev);
+
+	// device objects of meshes and textures into dst
+	void UploadResources(const ur::Device& dev, Model& dst);
+	// of one mesh, vertices from geo
+	static std::shared_ptr<ur::VertexArray> CreateVertexArray(const ur::Device& dev,
+		const MeshGeometry& geo, const MeshBuffers& buffers);
+
+	// true for the formats Load() leaves to Upload(), parsed on the device's
+	// thread: .param, .m3d, .xml, .mdl, .bsp and .map
+	static bool IsDeferred(const std::string& filepath);
+
+	// of the staged data, empty once uploaded or when deferred
+	UploadStats GetUploadStats() const;
+
+	// interleaved layout AssimpHelper and GltfLoader pack: pos3 [normal3]
+	// [texcoord2] [texcoord2] [color u8x4] [indices u8x4 weights u8x4],
+	// attributes by VERTEX_FLAG_*
+	static std::vector<std::shared_ptr<ur::VertexInputAttribute>>
+		BuildVertexAttrs(unsigned int vertex_type, int& stride);
+
+}; // StagedModel
+
+}
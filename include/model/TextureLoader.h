@@ -1,6 +1,9 @@
 #pragma once
 
 #include <unirender/typedef.h>
+#include <unirender/TextureFormat.h>
+
+#include <memory>
 
 namespace ur { class Device; }
 
@@ -10,6 +13,22 @@ namespace model
 class TextureLoader
 {
 public:
+	// decoded pixels, no device needed
+	struct Image
+	{
+		int width = 0, height = 0;
+		ur::TextureFormat format = ur::TextureFormat::RGBA8;
+
+		std::shared_ptr<uint8_t> pixels = nullptr;
+
+		// of pixels, as Upload() hands them to the device
+		size_t GetSizeInBytes() const;
+	};
+
+	// Decode*() may run on any thread, Upload() on the device's
+	static bool DecodeFile(const char* filepath, Image& image);
+	static ur::TexturePtr Upload(const ur::Device& dev, const Image& image);
+
 	static ur::TexturePtr
         LoadFromFile(const ur::Device& dev, const char* filepath, int mipmap_levels = 0);
 	static ur::TexturePtr
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace model
+{
+
+// Time passed into ModelInstance::Update() by the caller, so instances can be
+// evaluated without GlobalClock, e.g. in parallel or offline.
+struct TimeContext
+{
+	// same unit as GlobalClock::GetTime()
+	float time = 0;
+
+	// multiplies every instance's own play speed
+	float speed = 1.0f;
+
+}; // TimeContext
+
+}
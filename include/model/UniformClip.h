@@ -0,0 +1,50 @@
+#pragma once
+
+#include "model/ClipSampler.h"
+#include "model/SkeletalAnim.h"
+
+#include <vector>
+
+namespace model
+{
+
+// One SkeletalAnim clip resampled at its ticks_per_second onto a uniform
+// grid. The frame is floor(time * rate), so there is no key search and the
+// cursors are not used.
+class UniformClip : public ClipSampler
+{
+public:
+	// samples src, which must have the clip's channels
+	UniformClip(const SkeletalAnim::ModelExtend& anim, const ClipSampler& src);
+
+	virtual void Sample(float time, Cursor* cursors, sm::vec3* trans,
+		sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask = nullptr) const override;
+
+	virtual int GetNumChannels() const override { return m_num_channels; }
+
+	virtual size_t GetMemSize() const override;
+
+	int GetNumFrames() const { return m_num_frames; }
+
+	// The local space grid, shared with PoseCache: num_frames samples evenly
+	// spaced over duration, frame major, per channel t3 r4 s3, each rotation
+	// in the previous frame's hemisphere so frames can be lerped.
+	static constexpr int STRIDE = 10;
+	static int    CalcNumFrames(const SkeletalAnim::ModelExtend& anim);
+	static size_t CalcMemSize(int num_frames, int num_channels);
+	static void   BakeFrames(const ClipSampler& src, float duration, int num_frames,
+		std::vector<float>& dst);
+
+private:
+	float m_duration = 0;
+	float m_rate = 0;
+
+	int m_num_channels = 0;
+	int m_num_frames = 0;
+
+	// frame major, per channel: t3 r4 s3
+	std::vector<float> m_data;
+
+}; // UniformClip
+
+}
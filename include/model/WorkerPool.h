@@ -0,0 +1,72 @@
+#pragma once
+
+#include <unirender/noncopyable.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace model
+{
+
+// Persistent worker threads for fork-join loops, shared by InstanceUpdater
+// and CpuSkinning::Skin(). ParallelFor() hands out chunks of [0, n) from an
+// atomic counter to the workers and the calling thread, and returns when all
+// are done. Loops from several threads run one after another; a loop started
+// from inside a chunk, e.g. Skin() in an InstanceUpdater callback, runs
+// inline on that thread.
+class WorkerPool : ur::noncopyable
+{
+public:
+	// thread_count <= 0 for one per hardware thread, the calling thread included
+	WorkerPool(int thread_count = 0);
+	~WorkerPool();
+
+	// f(begin, end) over chunks of up to chunk_size indices, runs on the
+	// calling thread alone if n fits in one chunk or it is nested
+	template <typename F>
+	void ParallelFor(size_t n, size_t chunk_size, const F& f)
+	{
+		Run(n, chunk_size, [](const void* f, size_t begin, size_t end) {
+			(*static_cast<const F*>(f))(begin, end);
+		}, &f);
+	}
+
+	int GetThreadCount() const { return static_cast<int>(m_workers.size()) + 1; }
+
+private:
+	// type erased without an allocation, unlike std::function
+	typedef void (*ChunkFunc)(const void* f, size_t begin, size_t end);
+
+	void Run(size_t n, size_t chunk_size, ChunkFunc func, const void* f);
+
+	void WorkerLoop();
+
+	void RunChunks();
+
+private:
+	std::vector<std::thread> m_workers;
+
+	// one loop at a time
+	std::mutex m_run_mutex;
+
+	std::mutex m_mutex;
+	std::condition_variable m_start_cv, m_done_cv;
+
+	uint64_t m_generation = 0;
+	int  m_busy = 0;
+	bool m_quit = false;
+
+	// current loop
+	size_t      m_count = 0;
+	size_t      m_chunk_size = 1;
+	ChunkFunc   m_func = nullptr;
+	const void* m_func_data = nullptr;
+
+	std::atomic<size_t> m_next;
+
+}; // WorkerPool
+
+}
@@ -15,11 +15,50 @@
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <thread>
 
 namespace
 {
 
+// below this many vertices or keys a scene's conversion stays on one thread
+const size_t MIN_PARALLEL_WORK = 65536;
+
+// f(i) for i in [0, n) on up to max_threads threads, the caller included.
+// Each index is done once, results go to per index slots.
+template <typename F>
+void parallel_for(size_t n, int max_threads, F f)
+{
+	const size_t n_threads = std::min<size_t>(std::max(max_threads, 1), n);
+	if (n_threads <= 1)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			f(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < n; i = next++) {
+			f(i);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(n_threads - 1);
+	for (size_t i = 1; i < n_threads; ++i) {
+		workers.emplace_back(worker);
+	}
+	worker();
+
+	for (auto& t : workers) {
+		t.join();
+	}
+}
+
 sm::mat4 trans_ai_mat(const C_STRUCT aiMatrix4x4& ai_mat)
 {
 	sm::mat4 mat;
@@ -99,7 +138,28 @@ namespace model
 bool     AssimpHelper::m_load_raw_data = false;
 uint32_t AssimpHelper::m_vert_color = 0;
 
-bool AssimpHelper::Load(const ur::Device& dev, Model& model, const std::string& filepath, float scale)
+bool AssimpHelper::Load(const ur::Device& dev, Model& model, const std::string& filepath, float scale,
+	                    const LoadOptions& opts)
+{
+	StagedModel staged;
+	if (!LoadScene(model, staged, filepath, scale, opts)) {
+		return false;
+	}
+	staged.UploadResources(dev, model);
+	return true;
+}
+
+bool AssimpHelper::Load(StagedModel& staged, const std::string& filepath, float scale,
+	                    const LoadOptions& opts)
+{
+	if (!staged.model) {
+		return false;
+	}
+	return LoadScene(*staged.model, staged, filepath, scale, opts);
+}
+
+bool AssimpHelper::LoadScene(Model& model, StagedModel& staged, const std::string& filepath, float scale,
+	                         const LoadOptions& opts)
 {
 	Assimp::Importer importer;
     importer.SetPropertyFloat(AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, scale);
@@ -127,14 +187,19 @@ bool AssimpHelper::Load(const ur::Device& dev, Model& model, const std::string&
 		return NULL;
 	}
 
+	const int max_threads = opts.import_threads > 0 ? opts.import_threads
+		: std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
 	// material
 	auto dir = std::filesystem::path(filepath).parent_path().string();
+	std::vector<std::string> tex_paths(ai_scene->mNumMaterials);
 	model.materials.reserve(ai_scene->mNumMaterials);
 	for (size_t i = 0; i < ai_scene->mNumMaterials; ++i)
 	{
 		auto src = ai_scene->mMaterials[i];
-		model.materials.push_back(LoadMaterial(dev, src, model, dir));
+		model.materials.push_back(LoadMaterial(src, dir, tex_paths[i]));
 	}
+	LoadTextures(staged, model, tex_paths, opts.decode_textures, max_threads);
 
     ////
     //for (size_t i = 0; i < ai_scene->mNumMeshes; ++i)
@@ -149,16 +214,22 @@ bool AssimpHelper::Load(const ur::Device& dev, Model& model, const std::string&
     //    }
     //}
 
-	// mesh
-	std::vector<sm::cube> meshes_aabb;
-	meshes_aabb.reserve(ai_scene->mNumMeshes);
+	// mesh, converted into per mesh slots and appended in scene order
+	size_t n_vert = 0;
+	for (size_t i = 0; i < ai_scene->mNumMeshes; ++i) {
+		n_vert += ai_scene->mMeshes[i]->mNumVertices;
+	}
+	std::vector<std::unique_ptr<Model::Mesh>> meshes(ai_scene->mNumMeshes);
+	std::vector<sm::cube> meshes_aabb(ai_scene->mNumMeshes);
+	staged.meshes.resize(ai_scene->mNumMeshes);
+	parallel_for(ai_scene->mNumMeshes, n_vert < MIN_PARALLEL_WORK ? 1 : max_threads, [&](size_t i) {
+		meshes[i] = LoadMesh(staged.meshes[i], model.materials, ai_scene->mMeshes[i], meshes_aabb[i]);
+	});
 	model.meshes.reserve(ai_scene->mNumMeshes);
 	for (size_t i = 0; i < ai_scene->mNumMeshes; ++i)
 	{
-		auto src = ai_scene->mMeshes[i];
-		sm::cube aabb;
-		model.meshes.push_back(LoadMesh(dev, model.materials, src, aabb));
-		meshes_aabb.push_back(aabb);
+		staged.meshes[i].mesh = model.meshes.size();
+		model.meshes.push_back(std::move(meshes[i]));
 	}
 
 	// only meshes
@@ -181,28 +252,60 @@ bool AssimpHelper::Load(const ur::Device& dev, Model& model, const std::string&
 		}
 
 		// bone
-		auto& nodes = ext->GetNodes();
 		for (auto& mesh : model.meshes) {
 			for (auto& bone : mesh->geometry.bones) {
-				bone.node = -1;
-				for (int i = 0, n = nodes.size(); i < n; ++i) {
-					if (nodes[i]->name == bone.name) {
-						bone.node = i;
-						break;
-					}
-				}
+				bone.node = ext->QueryNodeByName(bone.name);
 			}
 		}
 
 		// animation
-		std::vector<std::unique_ptr<SkeletalAnim::ModelExtend>> anims;
-		anims.reserve(ai_scene->mNumAnimations);
-		for (size_t i = 0; i < ai_scene->mNumAnimations; ++i) {
+		size_t n_keys = 0;
+		for (size_t i = 0; i < ai_scene->mNumAnimations; ++i)
+		{
 			auto src = ai_scene->mAnimations[i];
-			anims.push_back(LoadAnimation(src));
+			for (size_t j = 0; j < src->mNumChannels; ++j)
+			{
+				auto c = src->mChannels[j];
+				n_keys += c->mNumPositionKeys + c->mNumRotationKeys + c->mNumScalingKeys;
+			}
 		}
+		std::vector<std::unique_ptr<SkeletalAnim::ModelExtend>> anims(ai_scene->mNumAnimations);
+		parallel_for(ai_scene->mNumAnimations, n_keys < MIN_PARALLEL_WORK ? 1 : max_threads, [&](size_t i) {
+			anims[i] = LoadAnimation(ai_scene->mAnimations[i]);
+		});
 		ext->SetAnims(anims);
 
+		// drop channels no bone, mesh or attachment depends on
+		if (opts.optimize_anims)
+		{
+			std::vector<int> keep_nodes;
+			for (auto& mesh : model.meshes) {
+				for (auto& bone : mesh->geometry.bones) {
+					keep_nodes.push_back(bone.node);
+				}
+			}
+			auto& nodes = ext->GetNodes();
+			for (int i = 0, n = nodes.size(); i < n; ++i) {
+				if (!nodes[i]->meshes.empty()) {
+					keep_nodes.push_back(i);
+				}
+			}
+			for (auto& name : opts.anim_keep_nodes)
+			{
+				const int node = ext->QueryNodeByName(name);
+				if (node < 0) {
+					staged.unknown_keep_nodes.push_back(name);
+				} else {
+					keep_nodes.push_back(node);
+				}
+			}
+			staged.anim_opt_stats = ext->OptimizeAnims(keep_nodes);
+		}
+
+		if (opts.resample_anims) {
+			ext->ResampleAnims(SkeletalAnim::ResampleParams());
+		}
+
 		model.ext = std::move(ext);
 	}
 
@@ -336,7 +439,7 @@ int AssimpHelper::LoadNode(const aiScene* ai_scene, const aiNode* ai_node, Model
 }
 
 std::unique_ptr<Model::Mesh>
-AssimpHelper::LoadMesh(const ur::Device& dev, const std::vector<std::unique_ptr<Model::Material>>& materials,
+AssimpHelper::LoadMesh(StagedModel::MeshBuffers& buffers, const std::vector<std::unique_ptr<Model::Material>>& materials,
                        const aiMesh* ai_mesh, sm::cube& aabb)
 {
 	auto mesh = std::make_unique<Model::Mesh>();
@@ -451,7 +554,7 @@ AssimpHelper::LoadMesh(const ur::Device& dev, const std::vector<std::unique_ptr<
 		const aiFace& face = ai_mesh->mFaces[i];
 		count += face.mNumIndices;
 	}
-	std::vector<uint16_t> indices;
+	auto& indices = buffers.indices;
 	indices.reserve(count);
 
 	for (size_t i = 0; i < ai_mesh->mNumFaces; ++i) {
@@ -461,87 +564,23 @@ AssimpHelper::LoadMesh(const ur::Device& dev, const std::vector<std::unique_ptr<
 		}
 	}
 
-    auto va = dev.CreateVertexArray();
-
-    auto ibuf_sz = sizeof(uint16_t) * indices.size();
-    auto ibuf = dev.CreateIndexBuffer(ur::BufferUsageHint::StaticDraw, ibuf_sz);
-    ibuf->ReadFromMemory(indices.data(), ibuf_sz, 0);
-    va->SetIndexBuffer(ibuf);
-
-    auto vbuf_sz = sizeof(float) * floats_per_vertex * ai_mesh->mNumVertices;
-    auto vbuf = dev.CreateVertexBuffer(ur::BufferUsageHint::StaticDraw, vbuf_sz);
-    vbuf->ReadFromMemory(buf, vbuf_sz, 0);
-    va->SetVertexBuffer(vbuf);
-
-    std::vector<std::shared_ptr<ur::VertexInputAttribute>> vbuf_attrs;
-
-	int stride = 0;
-	// pos
-	stride += 4 * 3;
-	// normal
 	if (has_normal) {
-		stride += 4 * 3;
-	}
-	// texcoord
-	if (has_texcoord) {
-		stride += 4 * 2;
-	}
-	// color
-	if (has_color) {
-		stride += 4;
-	}
-	// skinned
-	if (has_skinned) {
-		stride += 4 + 4;
-	}
-
-	int offset = 0;
-	int attr_loc = 0;
-	// pos
-    vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-		attr_loc++, ur::ComponentDataType::Float, 3, offset, stride));
-	offset += 4 * 3;
-	// normal
-	if (has_normal)
-	{
 		mesh->geometry.vertex_type |= VERTEX_FLAG_NORMALS;
-        vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::Float, 3, offset, stride));
-		offset += 4 * 3;
 	}
-	// texcoord
-	if (has_texcoord)
-	{
+	if (has_texcoord) {
 		mesh->geometry.vertex_type |= VERTEX_FLAG_TEXCOORDS0;
-        vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::Float, 2, offset, stride));
-		offset += 4 * 2;
 	}
-	// color
-	if (has_color)
-	{
+	if (has_color) {
 		mesh->geometry.vertex_type |= VERTEX_FLAG_COLOR;
-        vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::UnsignedByte, 4, offset, stride));
-		offset += 4;
 	}
-	// skinned
-	if (has_skinned)
-	{
+	if (has_skinned) {
 		mesh->geometry.vertex_type |= VERTEX_FLAG_SKINNED;
-        // blend_indices
-        vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::UnsignedByte, 4, offset, stride));
-		offset += 4;
-        // blend_weights
-        vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::UnsignedByte, 4, offset, stride));
-		offset += 4;
 	}
 
-    va->SetVertexBufferAttrs(vbuf_attrs);
+	// vertex array built in StagedModel::UploadResources()
+	int stride = 0;
+	buffers.attrs = StagedModel::BuildVertexAttrs(mesh->geometry.vertex_type, stride);
 
-    mesh->geometry.vertex_array = va;
 //	mesh->geometry.sub_geometries.insert({ "default", SubmeshGeometry(vi.in, 0) });
 	mesh->geometry.sub_geometries.push_back(SubmeshGeometry(true, indices.size(), 0));
 	mesh->geometry.sub_geometry_materials.push_back(ai_mesh->mMaterialIndex);
@@ -558,6 +597,22 @@ AssimpHelper::LoadMesh(const ur::Device& dev, const std::vector<std::unique_ptr<
 		mesh->geometry.bones.push_back(dst);
 	}
 
+	// per bone bounds, cheap posed bounds without touching vertices
+	for (size_t i = 0; i < ai_mesh->mNumVertices; ++i)
+	{
+		auto& p = ai_mesh->mVertices[i];
+		const sm::vec3 pos(p.x, p.y, p.z);
+		for (auto& w : weights_per_vertex[i])
+		{
+			if (w.second > 0 && w.first < static_cast<int>(mesh->geometry.bones.size()))
+			{
+				auto& bone = mesh->geometry.bones[w.first];
+				bone.bound.Combine(bone.offset_trans * pos);
+			}
+		}
+	}
+	mesh->geometry.aabb = aabb;
+
 //	delete[] buf;
     mesh->geometry.n_vert = ai_mesh->mNumVertices;
     mesh->geometry.n_poly = ai_mesh->mNumFaces;
@@ -618,8 +673,7 @@ std::unique_ptr<MeshRawData> AssimpHelper::LoadMeshRawData(const aiMesh* ai_mesh
 }
 
 std::unique_ptr<Model::Material>
-AssimpHelper::LoadMaterial(const ur::Device& dev, const aiMaterial* ai_material,
-                           Model& model, const std::string& dir)
+AssimpHelper::LoadMaterial(const aiMaterial* ai_material, const std::string& dir, std::string& diffuse_path)
 {
 	auto material = std::make_unique<Model::Material>();
 
@@ -660,33 +714,67 @@ AssimpHelper::LoadMaterial(const ur::Device& dev, const aiMaterial* ai_material,
 		aiString path;
 		if (aiGetMaterialString(ai_material, AI_MATKEY_TEXTURE_DIFFUSE(0), &path) == AI_SUCCESS)
 		{
-			auto img_path = std::filesystem::canonical(std::filesystem::path(dir) / std::filesystem::path(path.C_Str())).string();
-			material->diffuse_tex = LoadTexture(dev, model, img_path);
+			// resolved to an index by LoadTextures(), a missing file fails there
+			diffuse_path = (std::filesystem::path(dir) / std::filesystem::path(path.C_Str())).lexically_normal().string();
 		}
 	}
 
 	return material;
 }
 
-int AssimpHelper::LoadTexture(const ur::Device& dev, Model& model, const std::string& filepath)
+void AssimpHelper::LoadTextures(StagedModel& staged, Model& model,
+                                const std::vector<std::string>& diffuse_paths, bool decode, int max_threads)
 {
-	int idx = 0;
-	for (auto& tex : model.textures)
+	// new paths in first use order
+	std::vector<std::string> paths;
+	for (auto& path : diffuse_paths)
 	{
-		if (tex.first == filepath) {
-			return idx;
+		if (path.empty() || std::find(paths.begin(), paths.end(), path) != paths.end()) {
+			continue;
+		}
+		auto itr = std::find_if(model.textures.begin(), model.textures.end(),
+			[&](const auto& tex) { return tex.first == path; });
+		if (itr == model.textures.end()) {
+			paths.push_back(path);
 		}
-		++idx;
 	}
 
-    auto tex = TextureLoader::LoadFromFile(dev, filepath.c_str());
-    if (!tex) {
-        return -1;
-    }
+	// decoded here, created in StagedModel::UploadResources()
+	std::vector<StagedModel::Texture> images(paths.size());
+	std::vector<uint8_t> decoded(paths.size(), 1);
+	if (decode)
+	{
+		parallel_for(paths.size(), max_threads, [&](size_t i) {
+			decoded[i] = TextureLoader::DecodeFile(paths[i].c_str(), images[i].image);
+		});
+	}
 
-	int ret = model.textures.size();
-	model.textures.push_back({ filepath, tex });
-	return ret;
+	// indices as if loaded one by one, failed ones stay out
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		if (!decoded[i]) {
+			continue;
+		}
+		const int idx = model.textures.size();
+		model.textures.push_back({ paths[i], nullptr });
+		if (decode)
+		{
+			images[i].tex = idx;
+			staged.textures.push_back(images[i]);
+		}
+	}
+
+	for (size_t i = 0; i < diffuse_paths.size(); ++i)
+	{
+		if (diffuse_paths[i].empty()) {
+			continue;
+		}
+		auto itr = std::find_if(model.textures.begin(), model.textures.end(),
+			[&](const auto& tex) { return tex.first == diffuse_paths[i]; });
+		if (itr != model.textures.end()) {
+			model.materials[i]->diffuse_tex = static_cast<int>(itr - model.textures.begin());
+		}
+	}
 }
 
 std::unique_ptr<SkeletalAnim::ModelExtend> AssimpHelper::LoadAnimation(const aiAnimation* ai_anim)
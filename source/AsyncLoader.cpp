@@ -0,0 +1,179 @@
+#include "model/AsyncLoader.h"
+#include "model/StagedModel.h"
+#include "model/Model.h"
+
+#include <algorithm>
+
+namespace model
+{
+
+AsyncLoader::AsyncLoader(int thread_count)
+{
+	if (thread_count <= 0) {
+		thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	}
+
+	m_workers.reserve(thread_count);
+	for (int i = 0; i < thread_count; ++i) {
+		m_workers.emplace_back(&AsyncLoader::WorkerLoop, this);
+	}
+}
+
+AsyncLoader::~AsyncLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_cv.notify_all();
+
+	for (auto& t : m_workers) {
+		t.join();
+	}
+}
+
+AsyncLoader::Ticket AsyncLoader::Load(const std::string& filepath, const Callback& cb, int priority,
+	                                  const LoadOptions& opts)
+{
+	auto req = std::make_shared<Request>();
+	req->filepath = filepath;
+	req->opts     = opts;
+	req->cb       = cb;
+	req->priority = priority;
+	// one import thread per worker, not hardware threads squared
+	if (req->opts.import_threads <= 0) {
+		req->opts.import_threads = 1;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		req->ticket = m_next_ticket++;
+		m_queued.insert({ MakeKey(*req), req });
+		m_requests.insert({ req->ticket, req });
+	}
+	m_cv.notify_one();
+
+	return req->ticket;
+}
+
+bool AsyncLoader::Cancel(Ticket ticket)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto itr = m_requests.find(ticket);
+	if (itr == m_requests.end()) {
+		return false;
+	}
+
+	auto& req = itr->second;
+	switch (req->state)
+	{
+	case State::Queued:
+		m_queued.erase(MakeKey(*req));
+		break;
+	case State::Loading:
+		// the worker drops it when done
+		req->cancelled = true;
+		break;
+	case State::Staged:
+		m_staged.erase(MakeKey(*req));
+		break;
+	}
+	m_requests.erase(itr);
+
+	return true;
+}
+
+bool AsyncLoader::SetPriority(Ticket ticket, int priority)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto itr = m_requests.find(ticket);
+	if (itr == m_requests.end()) {
+		return false;
+	}
+
+	auto req = itr->second;
+	if (req->state == State::Loading) {
+		req->priority = priority;
+		return true;
+	}
+
+	auto& list = req->state == State::Staged ? m_staged : m_queued;
+	list.erase(MakeKey(*req));
+	req->priority = priority;
+	list.insert({ MakeKey(*req), req });
+
+	return true;
+}
+
+size_t AsyncLoader::Upload(const ur::Device& dev, size_t max_count)
+{
+	std::vector<std::shared_ptr<Request>> reqs;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		while (!m_staged.empty() && reqs.size() < max_count)
+		{
+			auto itr = m_staged.begin();
+			reqs.push_back(itr->second);
+			m_requests.erase(itr->second->ticket);
+			m_staged.erase(itr);
+		}
+	}
+
+	for (auto& req : reqs)
+	{
+		auto model = req->staged ? req->staged->Upload(dev) : nullptr;
+		req->staged.reset();
+		if (req->cb) {
+			req->cb(model);
+		}
+	}
+
+	return reqs.size();
+}
+
+size_t AsyncLoader::GetPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_requests.size();
+}
+
+bool AsyncLoader::IsStreamed(const std::string& filepath)
+{
+	return !StagedModel::IsDeferred(filepath);
+}
+
+void AsyncLoader::WorkerLoop()
+{
+	while (true)
+	{
+		std::shared_ptr<Request> req;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [&] { return m_quit || !m_queued.empty(); });
+			if (m_quit) {
+				return;
+			}
+
+			auto itr = m_queued.begin();
+			req = itr->second;
+			req->state = State::Loading;
+			m_queued.erase(itr);
+		}
+
+		auto staged = StagedModel::Load(req->filepath, req->opts);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (req->cancelled) {
+				continue;
+			}
+			req->staged = std::move(staged);
+			req->state  = State::Staged;
+			m_staged.insert({ MakeKey(*req), req });
+		}
+	}
+}
+
+}
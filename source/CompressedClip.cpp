@@ -0,0 +1,312 @@
+#include "model/CompressedClip.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <math.h>
+
+namespace
+{
+
+const float TIME_STEPS  = 65535.0f;
+const float VALUE_STEPS = 65535.0f;
+
+// smallest-three components are within +-1/sqrt(2), 15 bits each
+const float QUAT_RANGE = 0.70710678f;
+const float QUAT_STEPS = 32767.0f;
+
+// same as PackedClip
+const float NLERP_MIN_DOT = 0.95f;
+
+// last key with time <= t (or key 0), O(1) when t is at or just after
+// the cursor key, O(log n) otherwise
+uint32_t find_key(const uint16_t* times, uint32_t count, float t, uint32_t cursor)
+{
+	const uint32_t last = count - 1;
+	if (cursor < count && t >= times[cursor])
+	{
+		if (cursor == last || t < times[cursor + 1]) {
+			return cursor;
+		}
+		if (cursor + 1 == last || t < times[cursor + 2]) {
+			return cursor + 1;
+		}
+	}
+
+	auto itr = std::upper_bound(times + 1, times + count, t);
+	return static_cast<uint32_t>(itr - times) - 1;
+}
+
+// the largest component is dropped and rebuilt from the unit length, its
+// index goes to the top bits of the first two words
+void encode_quat(const sm::Quaternion& q, uint16_t* dst)
+{
+	float c[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; ++i) {
+		if (fabs(c[i]) > fabs(c[largest])) {
+			largest = i;
+		}
+	}
+	const float sign = c[largest] < 0 ? -1.0f : 1.0f;
+
+	for (int i = 0, j = 0; i < 4; ++i)
+	{
+		if (i == largest) {
+			continue;
+		}
+		float f = std::min(1.0f, std::max(0.0f, (c[i] * sign / QUAT_RANGE + 1.0f) * 0.5f));
+		dst[j++] = static_cast<uint16_t>(roundf(f * QUAT_STEPS));
+	}
+	dst[0] |= (largest & 1) << 15;
+	dst[1] |= (largest >> 1) << 15;
+}
+
+sm::Quaternion decode_quat(const uint16_t* src)
+{
+	const int largest = (src[0] >> 15) | ((src[1] >> 15) << 1);
+
+	float c[4];
+	float sum = 0;
+	for (int i = 0, j = 0; i < 4; ++i)
+	{
+		if (i == largest) {
+			continue;
+		}
+		const float f = (src[j++] & 0x7fff) / QUAT_STEPS;
+		c[i] = (f * 2.0f - 1.0f) * QUAT_RANGE;
+		sum += c[i] * c[i];
+	}
+	c[largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+
+	sm::Quaternion q;
+	q.x = c[0]; q.y = c[1]; q.z = c[2]; q.w = c[3];
+	return q;
+}
+
+}
+
+namespace model
+{
+
+CompressedClip::CompressedClip(const SkeletalAnim::ModelExtend& anim)
+	: m_duration(anim.duration)
+	, m_num_channels(static_cast<int>(anim.channels.size()))
+{
+	m_pos_tracks.resize(m_num_channels);
+	m_rot_tracks.resize(m_num_channels);
+	m_scale_tracks.resize(m_num_channels);
+
+	size_t n_pos = 0, n_rot = 0, n_scale = 0;
+	for (auto& c : anim.channels) {
+		n_pos   += c->position_keys.size();
+		n_rot   += c->rotation_keys.size();
+		n_scale += c->scaling_keys.size();
+	}
+	m_pos_keys.time.reserve(n_pos);
+	m_pos_keys.value.reserve(n_pos * 3);
+	m_rot_keys.time.reserve(n_rot);
+	m_rot_keys.value.reserve(n_rot * 3);
+	m_scale_keys.time.reserve(n_scale);
+	m_scale_keys.value.reserve(n_scale * 3);
+
+	for (int i = 0; i < m_num_channels; ++i)
+	{
+		auto& c = anim.channels[i];
+		PushVec3Track(c->position_keys, m_pos_tracks[i], m_pos_keys);
+		PushQuatTrack(c->rotation_keys, m_rot_tracks[i]);
+		PushVec3Track(c->scaling_keys, m_scale_tracks[i], m_scale_keys);
+	}
+}
+
+void CompressedClip::Sample(float time, Cursor* cursors, sm::vec3* trans,
+	                        sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask) const
+{
+	const float qtime = m_duration > 0 ? std::min(1.0f, std::max(0.0f, time / m_duration)) * TIME_STEPS : 0;
+	for (int i = 0; i < m_num_channels; ++i)
+	{
+		if (channel_mask && !channel_mask[i]) {
+			continue;
+		}
+
+		auto& cursor = cursors[i];
+
+		if (m_pos_tracks[i].count == 0) {
+			trans[i].x = trans[i].y = trans[i].z = 0;
+		} else {
+			SampleVec3(m_pos_tracks[i], m_pos_keys, qtime, cursor.pos, trans[i]);
+		}
+
+		if (m_rot_tracks[i].count == 0) {
+			rot[i] = sm::Quaternion();
+		} else {
+			SampleQuat(m_rot_tracks[i], qtime, cursor.rot, rot[i]);
+		}
+
+		if (m_scale_tracks[i].count == 0) {
+			scale[i].x = scale[i].y = scale[i].z = 1;
+		} else {
+			SampleVec3(m_scale_tracks[i], m_scale_keys, qtime, cursor.scale, scale[i]);
+		}
+	}
+}
+
+size_t CompressedClip::GetMemSize() const
+{
+	size_t sz = sizeof(CompressedClip);
+	sz += (m_pos_tracks.capacity() + m_rot_tracks.capacity() + m_scale_tracks.capacity()) * sizeof(Track);
+	for (auto pool : { &m_pos_keys, &m_rot_keys, &m_scale_keys }) {
+		sz += (pool->time.capacity() + pool->value.capacity()) * sizeof(uint16_t);
+	}
+	return sz;
+}
+
+bool CompressedClip::FindKeys(const Track& track, const KeyPool& pool, float qtime,
+	                          uint32_t& cursor, uint32_t& k0, uint32_t& k1, float& factor) const
+{
+	if (track.count == 0) {
+		return false;
+	}
+
+	auto t = &pool.time[track.begin];
+	const uint32_t frame = find_key(t, track.count, qtime, cursor);
+	cursor = frame;
+
+	const uint32_t next_frame = (frame + 1) % track.count;
+	float diff_time = static_cast<float>(t[next_frame]) - t[frame];
+	if (diff_time < 0) {
+		diff_time += TIME_STEPS;
+	}
+
+	k0 = track.begin + frame;
+	k1 = track.begin + next_frame;
+	factor = diff_time > 0 ? (qtime - t[frame]) / diff_time : 0;
+
+	return true;
+}
+
+void CompressedClip::SampleVec3(const Track& track, const KeyPool& pool, float qtime,
+	                            uint32_t& cursor, sm::vec3& dst) const
+{
+	uint32_t k0, k1;
+	float f;
+	FindKeys(track, pool, qtime, cursor, k0, k1, f);
+
+	const uint16_t* a = &pool.value[k0 * 3];
+	const uint16_t* b = &pool.value[k1 * 3];
+	float v[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		const float qa = a[i], qb = b[i];
+		v[i] = track.min[i] + (qa + (qb - qa) * f) * track.step[i];
+	}
+	dst.x = v[0];
+	dst.y = v[1];
+	dst.z = v[2];
+}
+
+void CompressedClip::SampleQuat(const Track& track, float qtime, uint32_t& cursor,
+	                            sm::Quaternion& dst) const
+{
+	uint32_t k0, k1;
+	float f;
+	FindKeys(track, m_rot_keys, qtime, cursor, k0, k1, f);
+
+	auto a = decode_quat(&m_rot_keys.value[k0 * 3]);
+	auto b = decode_quat(&m_rot_keys.value[k1 * 3]);
+	if (k0 == k1 || f <= 0)
+	{
+		dst = a;
+		return;
+	}
+
+	float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	if (d < 0) {
+		b.x = -b.x; b.y = -b.y; b.z = -b.z; b.w = -b.w;
+		d = -d;
+	}
+
+	// keys far apart, slerp
+	if (d < NLERP_MIN_DOT)
+	{
+		dst.Slerp(a, b, f);
+		return;
+	}
+
+	float x = a.x + (b.x - a.x) * f;
+	float y = a.y + (b.y - a.y) * f;
+	float z = a.z + (b.z - a.z) * f;
+	float w = a.w + (b.w - a.w) * f;
+	float inv_len = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+	dst.x = x * inv_len;
+	dst.y = y * inv_len;
+	dst.z = z * inv_len;
+	dst.w = w * inv_len;
+}
+
+void CompressedClip::PushVec3Track(const std::vector<std::pair<float, sm::vec3>>& keys,
+	                               Track& track, KeyPool& pool)
+{
+	if (keys.empty()) {
+		return;
+	}
+
+	track.begin = static_cast<uint32_t>(pool.time.size());
+	track.count = static_cast<uint32_t>(keys.size());
+
+	float max[3];
+	for (int i = 0; i < 3; ++i) {
+		track.min[i] = max[i] = keys[0].second.xyz[i];
+	}
+	for (auto& key : keys) {
+		for (int i = 0; i < 3; ++i) {
+			track.min[i] = std::min(track.min[i], key.second.xyz[i]);
+			max[i] = std::max(max[i], key.second.xyz[i]);
+		}
+	}
+	for (int i = 0; i < 3; ++i) {
+		track.step[i] = (max[i] - track.min[i]) / VALUE_STEPS;
+	}
+
+	for (auto& key : keys)
+	{
+		pool.time.push_back(QuantizeTime(key.first));
+		for (int i = 0; i < 3; ++i)
+		{
+			float q = track.step[i] > 0 ? (key.second.xyz[i] - track.min[i]) / track.step[i] : 0;
+			pool.value.push_back(static_cast<uint16_t>(std::min(VALUE_STEPS, std::max(0.0f, roundf(q)))));
+		}
+	}
+}
+
+void CompressedClip::PushQuatTrack(const std::vector<std::pair<float, sm::Quaternion>>& keys,
+	                               Track& track)
+{
+	if (keys.empty()) {
+		return;
+	}
+
+	auto& pool = m_rot_keys;
+	track.begin = static_cast<uint32_t>(pool.time.size());
+	track.count = static_cast<uint32_t>(keys.size());
+	for (auto& key : keys)
+	{
+		pool.time.push_back(QuantizeTime(key.first));
+
+		uint16_t v[3];
+		encode_quat(key.second, v);
+		pool.value.insert(pool.value.end(), v, v + 3);
+	}
+}
+
+uint16_t CompressedClip::QuantizeTime(float time) const
+{
+	if (m_duration <= 0) {
+		return 0;
+	}
+	float f = std::min(1.0f, std::max(0.0f, time / m_duration));
+	return static_cast<uint16_t>(roundf(f * TIME_STEPS));
+}
+
+}
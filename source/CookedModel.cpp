@@ -0,0 +1,923 @@
+#include "model/CookedModel.h"
+#include "model/StagedModel.h"
+#include "model/Model.h"
+#include "model/SkeletalAnim.h"
+#include "model/CompressedClip.h"
+#include "model/TextureLoader.h"
+
+#include <unirender/Device.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <vector>
+#include <memory>
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+
+const char     MAGIC[4]   = { 'M', 'D', 'L', 'C' };
+const uint32_t ENDIAN_TAG = 0x01020304;
+
+// vertex and index blobs start at this alignment in the file, so they are
+// aligned in the mapping too
+const size_t BLOB_ALIGN = 16;
+
+#ifdef BLENDSHAPE_COMPRESS_FLOAT
+#ifdef BLENDSHAPE_COMPRESS_TO8
+const uint32_t BLENDSHAPE_ENCODING = 2;
+#else
+const uint32_t BLENDSHAPE_ENCODING = 1;
+#endif // BLENDSHAPE_COMPRESS_TO8
+#else
+const uint32_t BLENDSHAPE_ENCODING = 0;
+#endif // BLENDSHAPE_COMPRESS_FLOAT
+
+enum ExtKind : uint8_t
+{
+	EXT_KIND_NONE = 0,
+	EXT_KIND_SKELETAL,
+};
+
+class MappedFile
+{
+public:
+	static std::shared_ptr<MappedFile> Open(const std::string& filepath);
+	~MappedFile();
+
+	const uint8_t* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+private:
+	MappedFile() {}
+
+private:
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#endif
+
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+
+}; // MappedFile
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string& filepath)
+{
+	std::shared_ptr<MappedFile> ret(new MappedFile());
+
+#ifdef _WIN32
+	ret->m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (ret->m_file == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(ret->m_file, &size) || size.QuadPart == 0) {
+		return nullptr;
+	}
+
+	ret->m_mapping = CreateFileMappingA(ret->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!ret->m_mapping) {
+		return nullptr;
+	}
+
+	auto data = MapViewOfFile(ret->m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		return nullptr;
+	}
+	ret->m_data = static_cast<const uint8_t*>(data);
+	ret->m_size = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	// the mapping outlives the descriptor
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return nullptr;
+	}
+	ret->m_data = static_cast<const uint8_t*>(data);
+	ret->m_size = static_cast<size_t>(st.st_size);
+#endif
+
+	return ret;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_file);
+	}
+#else
+	if (m_data) {
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+	}
+#endif
+}
+
+class Writer
+{
+public:
+	Writer(std::ofstream& fout) : m_fout(fout) {}
+
+	void Bytes(const void* data, size_t size)
+	{
+		if (size > 0) {
+			m_fout.write(static_cast<const char*>(data), size);
+		}
+		m_offset += size;
+	}
+
+	template<typename T>
+	void Pod(const T& val) { Bytes(&val, sizeof(T)); }
+
+	template<typename T>
+	void PodArray(const std::vector<T>& vals)
+	{
+		Pod(static_cast<uint32_t>(vals.size()));
+		Bytes(vals.data(), vals.size() * sizeof(T));
+	}
+
+	void String(const std::string& str)
+	{
+		Pod(static_cast<uint32_t>(str.size()));
+		Bytes(str.data(), str.size());
+	}
+
+	void Vec3(const sm::vec3& v) {
+		Pod(v.x); Pod(v.y); Pod(v.z);
+	}
+	void Quat(const sm::Quaternion& q) {
+		Pod(q.x); Pod(q.y); Pod(q.z); Pod(q.w);
+	}
+	void Mat4(const sm::mat4& m) {
+		Bytes(m.x, sizeof(m.x));
+	}
+	void Cube(const sm::cube& c) {
+		Pod(c.xmin); Pod(c.ymin); Pod(c.zmin);
+		Pod(c.xmax); Pod(c.ymax); Pod(c.zmax);
+	}
+
+	void Align()
+	{
+		static const uint8_t zeros[BLOB_ALIGN] = {};
+		Bytes(zeros, (BLOB_ALIGN - m_offset % BLOB_ALIGN) % BLOB_ALIGN);
+	}
+
+	bool IsValid() const { return m_fout.good(); }
+
+private:
+	std::ofstream& m_fout;
+
+	size_t m_offset = 0;
+
+}; // Writer
+
+// Bounds checked, a failed read leaves zeros and makes IsValid() false.
+class Reader
+{
+public:
+	Reader(const uint8_t* data, size_t size)
+		: m_data(data), m_size(size) {}
+
+	const uint8_t* Bytes(size_t size)
+	{
+		if (!m_valid || size > m_size - m_pos)
+		{
+			m_valid = false;
+			return nullptr;
+		}
+		auto ret = m_data + m_pos;
+		m_pos += size;
+		return ret;
+	}
+
+	template<typename T>
+	T Pod()
+	{
+		T ret = T();
+		if (auto src = Bytes(sizeof(T))) {
+			memcpy(&ret, src, sizeof(T));
+		}
+		return ret;
+	}
+
+	template<typename T>
+	void PodArray(std::vector<T>& vals)
+	{
+		const size_t n = Pod<uint32_t>();
+		auto src = Bytes(n * sizeof(T));
+		vals.resize(src ? n : 0);
+		if (src && n > 0) {
+			memcpy(vals.data(), src, n * sizeof(T));
+		}
+	}
+
+	std::string String()
+	{
+		const size_t n = Pod<uint32_t>();
+		auto src = Bytes(n);
+		return src ? std::string(reinterpret_cast<const char*>(src), n) : std::string();
+	}
+
+	sm::vec3 Vec3()
+	{
+		sm::vec3 v;
+		v.x = Pod<float>(); v.y = Pod<float>(); v.z = Pod<float>();
+		return v;
+	}
+	sm::Quaternion Quat()
+	{
+		sm::Quaternion q;
+		q.x = Pod<float>(); q.y = Pod<float>(); q.z = Pod<float>(); q.w = Pod<float>();
+		return q;
+	}
+	sm::mat4 Mat4()
+	{
+		sm::mat4 m;
+		if (auto src = Bytes(sizeof(m.x))) {
+			memcpy(m.x, src, sizeof(m.x));
+		}
+		return m;
+	}
+	sm::cube Cube()
+	{
+		sm::cube c;
+		c.xmin = Pod<float>(); c.ymin = Pod<float>(); c.zmin = Pod<float>();
+		c.xmax = Pod<float>(); c.ymax = Pod<float>(); c.zmax = Pod<float>();
+		return c;
+	}
+
+	void Align() {
+		Bytes((BLOB_ALIGN - m_pos % BLOB_ALIGN) % BLOB_ALIGN);
+	}
+
+	bool IsValid() const { return m_valid; }
+
+	size_t Remaining() const { return m_valid ? m_size - m_pos : 0; }
+
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+
+	size_t m_pos = 0;
+	bool   m_valid = true;
+
+}; // Reader
+
+// indices read back are checked against the counts already read, the
+// loaded model follows them without checks
+bool in_range(int idx, size_t count)
+{
+	return idx >= 0 && static_cast<size_t>(idx) < count;
+}
+
+bool in_range_or_none(int idx, size_t count)
+{
+	return idx == -1 || in_range(idx, count);
+}
+
+// every parent chain ends at a root, so SkeletalAnim's eval order reaches
+// all nodes
+bool parents_acyclic(const std::vector<std::unique_ptr<model::SkeletalAnim::Node>>& nodes)
+{
+	// 0 unvisited, 1 on the current chain, 2 reaches a root
+	std::vector<uint8_t> state(nodes.size(), 0);
+	std::vector<int> chain;
+	for (int i = 0, n = nodes.size(); i < n; ++i)
+	{
+		int node = i;
+		while (node >= 0 && state[node] == 0)
+		{
+			state[node] = 1;
+			chain.push_back(node);
+			node = nodes[node]->parent;
+		}
+		if (node >= 0 && state[node] == 1) {
+			return false;
+		}
+		for (auto c : chain) {
+			state[c] = 2;
+		}
+		chain.clear();
+	}
+	return true;
+}
+
+// [offset, offset + count) inside [0, size)
+bool range_fits(size_t offset, size_t count, size_t size)
+{
+	return offset <= size && count <= size - offset;
+}
+
+void write_keys(Writer& w, const std::vector<std::pair<float, sm::vec3>>& keys)
+{
+	w.Pod(static_cast<uint32_t>(keys.size()));
+	for (auto& key : keys) {
+		w.Pod(key.first);
+		w.Vec3(key.second);
+	}
+}
+
+void write_keys(Writer& w, const std::vector<std::pair<float, sm::Quaternion>>& keys)
+{
+	w.Pod(static_cast<uint32_t>(keys.size()));
+	for (auto& key : keys) {
+		w.Pod(key.first);
+		w.Quat(key.second);
+	}
+}
+
+void read_keys(Reader& r, std::vector<std::pair<float, sm::vec3>>& keys)
+{
+	const uint32_t n = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n && r.IsValid(); ++i)
+	{
+		const float time = r.Pod<float>();
+		keys.push_back({ time, r.Vec3() });
+	}
+}
+
+void read_keys(Reader& r, std::vector<std::pair<float, sm::Quaternion>>& keys)
+{
+	const uint32_t n = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n && r.IsValid(); ++i)
+	{
+		const float time = r.Pod<float>();
+		keys.push_back({ time, r.Quat() });
+	}
+}
+
+// false for clips quantized by SkeletalAnim::CompressAnims(), their keys
+// only live in the CompressedClip streams
+bool write_skeletal(Writer& w, const model::SkeletalAnim& sk_anim)
+{
+	auto& anims = sk_anim.GetAnims();
+	for (auto& anim : anims) {
+		if (std::dynamic_pointer_cast<const model::CompressedClip>(anim->sampler)) {
+			return false;
+		}
+	}
+
+	auto& nodes = sk_anim.GetNodes();
+	w.Pod(static_cast<uint32_t>(nodes.size()));
+	for (auto& node : nodes)
+	{
+		w.String(node->name);
+		w.Pod(static_cast<int32_t>(node->parent));
+		w.PodArray(node->children);
+		w.PodArray(node->meshes);
+		w.Mat4(node->local_trans);
+		w.Pod(static_cast<int32_t>(node->channel_idx));
+	}
+
+	w.Pod(static_cast<uint32_t>(anims.size()));
+	for (auto& anim : anims)
+	{
+		w.String(anim->name);
+		w.Pod(anim->duration);
+		w.Pod(anim->ticks_per_second);
+		w.Pod(static_cast<uint32_t>(anim->channels.size()));
+		for (auto& c : anim->channels)
+		{
+			w.String(c->name);
+			write_keys(w, c->position_keys);
+			write_keys(w, c->rotation_keys);
+			write_keys(w, c->scaling_keys);
+		}
+	}
+
+	return true;
+}
+
+std::unique_ptr<model::SkeletalAnim> read_skeletal(Reader& r, size_t n_meshes)
+{
+	auto sk_anim = std::make_unique<model::SkeletalAnim>();
+
+	std::vector<std::unique_ptr<model::SkeletalAnim::Node>> nodes;
+	const uint32_t n_nodes = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n_nodes && r.IsValid(); ++i)
+	{
+		auto node = std::make_unique<model::SkeletalAnim::Node>();
+		node->name = r.String();
+		node->parent = r.Pod<int32_t>();
+		r.PodArray(node->children);
+		r.PodArray(node->meshes);
+		node->local_trans = r.Mat4();
+		node->channel_idx = r.Pod<int32_t>();
+		nodes.push_back(std::move(node));
+	}
+
+	std::vector<std::unique_ptr<model::SkeletalAnim::ModelExtend>> anims;
+	const uint32_t n_anims = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n_anims && r.IsValid(); ++i)
+	{
+		auto anim = std::make_unique<model::SkeletalAnim::ModelExtend>();
+		anim->name = r.String();
+		anim->duration = r.Pod<float>();
+		anim->ticks_per_second = r.Pod<float>();
+
+		const uint32_t n_channels = r.Pod<uint32_t>();
+		for (uint32_t j = 0; j < n_channels && r.IsValid(); ++j)
+		{
+			auto c = std::make_shared<model::SkeletalAnim::NodeAnim>();
+			c->name = r.String();
+			read_keys(r, c->position_keys);
+			read_keys(r, c->rotation_keys);
+			read_keys(r, c->scaling_keys);
+			anim->channels.push_back(c);
+		}
+		anims.push_back(std::move(anim));
+	}
+
+	if (!r.IsValid()) {
+		return nullptr;
+	}
+
+	size_t max_channels = 0;
+	for (auto& anim : anims) {
+		max_channels = std::max(max_channels, anim->channels.size());
+	}
+	for (int i = 0, n = nodes.size(); i < n; ++i)
+	{
+		auto& node = nodes[i];
+		if (!in_range_or_none(node->parent, n) || node->parent == i
+		 || !in_range_or_none(node->channel_idx, max_channels)) {
+			return nullptr;
+		}
+		for (auto child : node->children) {
+			if (!in_range(child, n)) {
+				return nullptr;
+			}
+		}
+		for (auto mesh : node->meshes) {
+			if (!in_range(mesh, n_meshes)) {
+				return nullptr;
+			}
+		}
+	}
+
+	if (!parents_acyclic(nodes)) {
+		return nullptr;
+	}
+
+	sk_anim->SetNodes(nodes);
+	sk_anim->SetAnims(anims);
+
+	return sk_anim;
+}
+
+// relative to the source file's directory, so the cooked file can move
+// with its textures; absolute only if there is no relative path, e.g.
+// another drive
+std::string relative_tex_path(const std::string& tex_path, const std::string& src_path)
+{
+	std::error_code ec;
+	auto tex = std::filesystem::absolute(tex_path, ec);
+	auto dir = std::filesystem::absolute(std::filesystem::path(src_path).parent_path(), ec);
+	if (ec) {
+		return tex_path;
+	}
+	auto rel = tex.lexically_relative(dir);
+	return rel.empty() ? tex.generic_string() : rel.generic_string();
+}
+
+// against the cooked file's directory
+std::string resolve_tex_path(const std::string& tex_path, const std::string& cooked_path)
+{
+	std::filesystem::path path(tex_path);
+	if (path.is_absolute()) {
+		return tex_path;
+	}
+	return (std::filesystem::path(cooked_path).parent_path() / path).lexically_normal().string();
+}
+
+}
+
+namespace model
+{
+
+const uint32_t CookedModel::VERSION;
+
+bool CookedModel::Save(const StagedModel& staged, const std::string& filepath)
+{
+	if (!staged.model || staged.deferred) {
+		return false;
+	}
+
+	auto& model = *staged.model;
+	if (model.ext && model.ext->Type() != EXT_SKELETAL) {
+		return false;
+	}
+
+	// only the paths are kept, so every texture needs a file
+	for (auto& tex : model.textures) {
+		if (tex.first.empty() || tex.first.compare(0, 5, "data:") == 0) {
+			return false;
+		}
+	}
+
+	std::ofstream fout(filepath, std::ios::binary);
+	if (fout.fail()) {
+		return false;
+	}
+
+	Writer w(fout);
+
+	// header
+	w.Bytes(MAGIC, sizeof(MAGIC));
+	w.Pod(VERSION);
+	w.Pod(ENDIAN_TAG);
+	w.Pod(BLENDSHAPE_ENCODING);
+
+	w.Pod(model.anim_speed);
+	w.Pod(model.scale);
+	w.Cube(model.aabb);
+
+	// texture
+	w.Pod(static_cast<uint32_t>(model.textures.size()));
+	for (auto& tex : model.textures) {
+		w.String(relative_tex_path(tex.first, staged.filepath));
+	}
+
+	// material
+	w.Pod(static_cast<uint32_t>(model.materials.size()));
+	for (auto& mat : model.materials)
+	{
+		w.Vec3(mat->ambient);
+		w.Vec3(mat->diffuse);
+		w.Vec3(mat->specular);
+		w.Pod(mat->shininess);
+		w.Pod(static_cast<int32_t>(mat->diffuse_tex));
+		w.Pod(static_cast<int32_t>(mat->metallic_roughness_tex));
+		w.Pod(static_cast<int32_t>(mat->emissive_tex));
+		w.Pod(static_cast<int32_t>(mat->occlusion_tex));
+		w.Pod(static_cast<int32_t>(mat->normal_tex));
+	}
+
+	// mesh
+	w.Pod(static_cast<uint32_t>(model.meshes.size()));
+	for (size_t i = 0, n = model.meshes.size(); i < n; ++i)
+	{
+		auto& mesh = model.meshes[i];
+		auto& geo = mesh->geometry;
+
+		w.String(mesh->name);
+		w.Pod(static_cast<int32_t>(mesh->material));
+
+		w.Pod(static_cast<uint32_t>(geo.vertex_type));
+		w.Pod(static_cast<uint64_t>(geo.n_vert));
+		w.Pod(static_cast<uint64_t>(geo.n_poly));
+		w.Pod(static_cast<uint64_t>(geo.vert_stride));
+		w.Cube(geo.aabb);
+
+		w.Pod(static_cast<uint32_t>(geo.sub_geometries.size()));
+		for (auto& sub : geo.sub_geometries) {
+			w.Pod(static_cast<uint8_t>(sub.index));
+			w.Pod(static_cast<uint64_t>(sub.count));
+			w.Pod(static_cast<uint64_t>(sub.offset));
+		}
+		w.PodArray(geo.sub_geometry_materials);
+
+		w.Pod(static_cast<uint32_t>(geo.bones.size()));
+		for (auto& bone : geo.bones)
+		{
+			w.Pod(static_cast<int32_t>(bone.node));
+			w.String(bone.name);
+			w.Mat4(bone.offset_trans);
+			w.Cube(bone.bound);
+		}
+
+		w.Pod(static_cast<uint32_t>(geo.blendshape_data.size()));
+		for (auto& bs : geo.blendshape_data)
+		{
+			w.String(bs->name);
+#ifdef BLENDSHAPE_COMPRESS_FLOAT
+			w.Pod(bs->flt_min);
+			w.Pod(bs->flt_max);
+			w.PodArray(bs->off_verts_idx);
+#else
+			w.Pod(static_cast<uint32_t>(bs->off_verts.size()));
+			for (auto& v : bs->off_verts) {
+				w.Vec3(v);
+			}
+#endif // BLENDSHAPE_COMPRESS_FLOAT
+			w.PodArray(bs->idx_verts);
+		}
+
+		// blobs
+		const size_t vert_sz = geo.vert_buf ? geo.n_vert * geo.vert_stride : 0;
+		w.Pod(static_cast<uint64_t>(vert_sz));
+		w.Align();
+		w.Bytes(geo.vert_buf, vert_sz);
+
+		const void* indices = nullptr;
+		size_t n_indices = 0;
+		uint8_t index_size = sizeof(uint16_t);
+		for (auto& mb : staged.meshes)
+		{
+			if (mb.mesh == static_cast<int>(i))
+			{
+				indices    = mb.GetIndexData();
+				n_indices  = mb.GetIndexCount();
+				index_size = mb.HasIndices32() ? sizeof(uint32_t) : sizeof(uint16_t);
+				break;
+			}
+		}
+		w.Pod(index_size);
+		w.Pod(static_cast<uint64_t>(n_indices));
+		w.Align();
+		w.Bytes(indices, n_indices * index_size);
+	}
+
+	// node
+	w.Pod(static_cast<uint32_t>(model.nodes.size()));
+	for (auto& node : model.nodes) {
+		w.Mat4(node->mat);
+		w.Pod(static_cast<int32_t>(node->mesh));
+	}
+
+	// ext
+	if (model.ext)
+	{
+		w.Pod(static_cast<uint8_t>(EXT_KIND_SKELETAL));
+		if (!write_skeletal(w, static_cast<const SkeletalAnim&>(*model.ext))) {
+			return false;
+		}
+	}
+	else
+	{
+		w.Pod(static_cast<uint8_t>(EXT_KIND_NONE));
+	}
+
+	fout.flush();
+	return w.IsValid();
+}
+
+bool CookedModel::Load(const ur::Device& dev, Model& model, const std::string& filepath)
+{
+	StagedModel staged;
+	if (!LoadModel(model, staged, filepath)) {
+		return false;
+	}
+	staged.UploadResources(dev, model);
+	return true;
+}
+
+bool CookedModel::Load(StagedModel& staged, const std::string& filepath)
+{
+	if (!staged.model) {
+		return false;
+	}
+	return LoadModel(*staged.model, staged, filepath);
+}
+
+bool CookedModel::LoadModel(Model& model, StagedModel& staged, const std::string& filepath)
+{
+	auto file = MappedFile::Open(filepath);
+	if (!file) {
+		return false;
+	}
+
+	Reader r(file->Data(), file->Size());
+
+	// header
+	auto magic = r.Bytes(sizeof(MAGIC));
+	if (!magic || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+	 || r.Pod<uint32_t>() != VERSION
+	 || r.Pod<uint32_t>() != ENDIAN_TAG
+	 || r.Pod<uint32_t>() != BLENDSHAPE_ENCODING) {
+		return false;
+	}
+
+	model.anim_speed = r.Pod<float>();
+	model.scale      = r.Pod<float>();
+	model.aabb       = r.Cube();
+
+	// texture
+	const uint32_t n_tex = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n_tex && r.IsValid(); ++i)
+	{
+		auto path = resolve_tex_path(r.String(), filepath);
+
+		StagedModel::Texture tex;
+		tex.tex = model.textures.size();
+		if (TextureLoader::DecodeFile(path.c_str(), tex.image)) {
+			staged.textures.push_back(tex);
+		}
+		model.textures.push_back({ path, nullptr });
+	}
+
+	// material
+	const uint32_t n_mat = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n_mat && r.IsValid(); ++i)
+	{
+		auto mat = std::make_unique<Model::Material>();
+		mat->ambient   = r.Vec3();
+		mat->diffuse   = r.Vec3();
+		mat->specular  = r.Vec3();
+		mat->shininess = r.Pod<float>();
+		mat->diffuse_tex            = r.Pod<int32_t>();
+		mat->metallic_roughness_tex = r.Pod<int32_t>();
+		mat->emissive_tex           = r.Pod<int32_t>();
+		mat->occlusion_tex          = r.Pod<int32_t>();
+		mat->normal_tex             = r.Pod<int32_t>();
+
+		const size_t n_tex = model.textures.size();
+		if (!in_range_or_none(mat->diffuse_tex, n_tex)
+		 || !in_range_or_none(mat->metallic_roughness_tex, n_tex)
+		 || !in_range_or_none(mat->emissive_tex, n_tex)
+		 || !in_range_or_none(mat->occlusion_tex, n_tex)
+		 || !in_range_or_none(mat->normal_tex, n_tex)) {
+			return false;
+		}
+
+		model.materials.push_back(std::move(mat));
+	}
+
+	// mesh
+	const uint32_t n_mesh = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n_mesh && r.IsValid(); ++i)
+	{
+		auto mesh = std::make_unique<Model::Mesh>();
+		auto& geo = mesh->geometry;
+
+		mesh->name     = r.String();
+		mesh->material = r.Pod<int32_t>();
+		if (!in_range_or_none(mesh->material, model.materials.size())) {
+			return false;
+		}
+
+		geo.vertex_type = r.Pod<uint32_t>();
+		geo.n_vert      = static_cast<size_t>(r.Pod<uint64_t>());
+		geo.n_poly      = static_cast<size_t>(r.Pod<uint64_t>());
+		geo.vert_stride = static_cast<size_t>(r.Pod<uint64_t>());
+		geo.aabb        = r.Cube();
+
+		const uint32_t n_sub = r.Pod<uint32_t>();
+		for (uint32_t j = 0; j < n_sub && r.IsValid(); ++j)
+		{
+			const bool index = r.Pod<uint8_t>() != 0;
+			const size_t count = static_cast<size_t>(r.Pod<uint64_t>());
+			geo.sub_geometries.push_back(SubmeshGeometry(index, count, static_cast<size_t>(r.Pod<uint64_t>())));
+		}
+		r.PodArray(geo.sub_geometry_materials);
+		for (auto mat : geo.sub_geometry_materials) {
+			if (mat >= model.materials.size()) {
+				return false;
+			}
+		}
+
+		const uint32_t n_bone = r.Pod<uint32_t>();
+		for (uint32_t j = 0; j < n_bone && r.IsValid(); ++j)
+		{
+			Bone bone;
+			bone.node         = r.Pod<int32_t>();
+			bone.name         = r.String();
+			bone.offset_trans = r.Mat4();
+			bone.bound        = r.Cube();
+			geo.bones.push_back(bone);
+		}
+
+		const uint32_t n_bs = r.Pod<uint32_t>();
+		for (uint32_t j = 0; j < n_bs && r.IsValid(); ++j)
+		{
+			auto bs = std::make_unique<BlendShapeData>();
+			bs->name = r.String();
+#ifdef BLENDSHAPE_COMPRESS_FLOAT
+			bs->flt_min = r.Pod<float>();
+			bs->flt_max = r.Pod<float>();
+			r.PodArray(bs->off_verts_idx);
+#else
+			const uint32_t n_off = r.Pod<uint32_t>();
+			// the count is untrusted, cap it by what is left in the file
+			bs->off_verts.reserve(std::min<size_t>(n_off, r.Remaining() / (3 * sizeof(float))));
+			for (uint32_t k = 0; k < n_off && r.IsValid(); ++k) {
+				bs->off_verts.push_back(r.Vec3());
+			}
+#endif // BLENDSHAPE_COMPRESS_FLOAT
+			r.PodArray(bs->idx_verts);
+			geo.blendshape_data.push_back(std::move(bs));
+		}
+
+		// blobs stay in the mapping, which the geometry keeps alive
+		const size_t vert_sz = static_cast<size_t>(r.Pod<uint64_t>());
+		r.Align();
+		auto verts = r.Bytes(vert_sz);
+		if (vert_sz != geo.n_vert * geo.vert_stride) {
+			return false;
+		}
+		if (verts && vert_sz > 0)
+		{
+			geo.vert_buf = verts;
+			geo.vert_buf_storage = file;
+		}
+
+		StagedModel::MeshBuffers mb;
+		mb.mesh = model.meshes.size();
+		const uint8_t index_size = r.Pod<uint8_t>();
+		mb.index_count = static_cast<size_t>(r.Pod<uint64_t>());
+		if ((index_size != sizeof(uint16_t) && index_size != sizeof(uint32_t))
+		 || mb.index_count > std::numeric_limits<size_t>::max() / index_size) {
+			return false;
+		}
+		r.Align();
+		auto index_data = r.Bytes(mb.index_count * index_size);
+		if (index_size == sizeof(uint32_t)) {
+			mb.index_data32 = reinterpret_cast<const uint32_t*>(index_data);
+		} else {
+			mb.index_data = reinterpret_cast<const uint16_t*>(index_data);
+		}
+
+		int stride = 0;
+		mb.attrs = StagedModel::BuildVertexAttrs(geo.vertex_type, stride);
+		if (!r.IsValid() || static_cast<size_t>(stride) != geo.vert_stride) {
+			return false;
+		}
+		for (auto& sub : geo.sub_geometries) {
+			if (!range_fits(sub.offset, sub.count, sub.index ? mb.index_count : geo.n_vert)) {
+				return false;
+			}
+		}
+
+		staged.meshes.push_back(mb);
+		model.meshes.push_back(std::move(mesh));
+	}
+
+	// node
+	const uint32_t n_node = r.Pod<uint32_t>();
+	for (uint32_t i = 0; i < n_node && r.IsValid(); ++i)
+	{
+		auto node = std::make_unique<Model::Node>();
+		node->mat  = r.Mat4();
+		node->mesh = r.Pod<int32_t>();
+		if (!in_range_or_none(node->mesh, model.meshes.size())) {
+			return false;
+		}
+		model.nodes.push_back(std::move(node));
+	}
+
+	// ext
+	switch (r.Pod<uint8_t>())
+	{
+	case EXT_KIND_NONE:
+		break;
+	case EXT_KIND_SKELETAL:
+	{
+		auto sk_anim = read_skeletal(r, model.meshes.size());
+		if (!sk_anim) {
+			return false;
+		}
+		// bones resolve to skeleton nodes, which come after the meshes
+		const size_t n_nodes = sk_anim->GetNodes().size();
+		for (auto& mesh : model.meshes) {
+			for (auto& bone : mesh->geometry.bones) {
+				if (!in_range_or_none(bone.node, n_nodes)) {
+					return false;
+				}
+			}
+		}
+		model.ext = std::move(sk_anim);
+		break;
+	}
+	default:
+		return false;
+	}
+
+	return r.IsValid();
+}
+
+}
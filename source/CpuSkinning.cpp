@@ -0,0 +1,166 @@
+#include "model/CpuSkinning.h"
+#include "model/WorkerPool.h"
+
+#include "CpuSkinningKernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MODEL_SKIN_SSE
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MODEL_SKIN_CPUID_GCC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MODEL_SKIN_CPUID_MSVC
+#include <intrin.h>
+#endif
+
+namespace
+{
+
+#if defined(MODEL_SKIN_SSE)
+
+void skin_vertex(const sm::mat4* palette, const SkinWeights& sw, const float* pos,
+	             const float* nor, sm::vec3& dst_pos, sm::vec3* dst_nor)
+{
+	__m128 c[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+	for (int i = 0; i < sw.n; ++i)
+	{
+		const float* m = palette[sw.idx[i]].x;
+		const __m128 w = _mm_set1_ps(sw.w[i]);
+		for (int j = 0; j < 4; ++j) {
+			c[j] = _mm_add_ps(c[j], _mm_mul_ps(_mm_loadu_ps(m + j * 4), w));
+		}
+	}
+
+	__m128 p = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(pos[0])), _mm_mul_ps(c[1], _mm_set1_ps(pos[1]))),
+		_mm_add_ps(_mm_mul_ps(c[2], _mm_set1_ps(pos[2])), c[3]));
+
+	float out[4];
+	_mm_storeu_ps(out, p);
+	dst_pos.x = out[0]; dst_pos.y = out[1]; dst_pos.z = out[2];
+
+	if (dst_nor)
+	{
+		p = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(nor[0])), _mm_mul_ps(c[1], _mm_set1_ps(nor[1]))),
+			_mm_mul_ps(c[2], _mm_set1_ps(nor[2])));
+
+		_mm_storeu_ps(out, p);
+		dst_nor->x = out[0]; dst_nor->y = out[1]; dst_nor->z = out[2];
+		normalize(*dst_nor);
+	}
+}
+
+#else
+
+void skin_vertex(const sm::mat4* palette, const SkinWeights& sw, const float* pos,
+	             const float* nor, sm::vec3& dst_pos, sm::vec3* dst_nor)
+{
+	float m[16];
+	memset(m, 0, sizeof(m));
+	for (int i = 0; i < sw.n; ++i)
+	{
+		const float* src = palette[sw.idx[i]].x;
+		const float w = sw.w[i];
+		for (int j = 0; j < 16; ++j) {
+			m[j] += src[j] * w;
+		}
+	}
+
+	dst_pos.x = pos[0] * m[0] + pos[1] * m[4] + pos[2] * m[8]  + m[12];
+	dst_pos.y = pos[0] * m[1] + pos[1] * m[5] + pos[2] * m[9]  + m[13];
+	dst_pos.z = pos[0] * m[2] + pos[1] * m[6] + pos[2] * m[10] + m[14];
+
+	if (dst_nor)
+	{
+		dst_nor->x = nor[0] * m[0] + nor[1] * m[4] + nor[2] * m[8];
+		dst_nor->y = nor[0] * m[1] + nor[1] * m[5] + nor[2] * m[9];
+		dst_nor->z = nor[0] * m[2] + nor[1] * m[6] + nor[2] * m[10];
+		normalize(*dst_nor);
+	}
+}
+
+#endif
+
+bool cpu_has_avx2()
+{
+#if defined(MODEL_SKIN_CPUID_GCC)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(MODEL_SKIN_CPUID_MSVC)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	// fma, osxsave and avx in leaf 1, the os must also save the ymm state
+	__cpuid(info, 1);
+	const int ecx_bits = (1 << 12) | (1 << 27) | (1 << 28);
+	if ((info[2] & ecx_bits) != ecx_bits || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+// checked once, on first use
+bool use_avx2()
+{
+	static const bool avx2 = model::SKIN_AVX2_BUILT && cpu_has_avx2();
+	return avx2;
+}
+
+}
+
+namespace model
+{
+
+void SkinRangeDefault(const MeshGeometry& geo, const sm::mat4* palette,
+	                  size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals)
+{
+	skin_range(geo, palette, begin, end, positions, normals, skin_vertex);
+}
+
+void CpuSkinning::Skin(const MeshGeometry& geo, const sm::mat4* palette,
+	                   sm::vec3* positions, sm::vec3* normals, WorkerPool* pool,
+	                   size_t vertices_per_task)
+{
+	if (!pool)
+	{
+		SkinRange(geo, palette, 0, geo.n_vert, positions, normals);
+		return;
+	}
+
+	pool->ParallelFor(geo.n_vert, vertices_per_task, [&](size_t begin, size_t end) {
+		SkinRange(geo, palette, begin, end, positions, normals);
+	});
+}
+
+void CpuSkinning::SkinRange(const MeshGeometry& geo, const sm::mat4* palette,
+	                        size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals)
+{
+	if (use_avx2()) {
+		SkinRangeAvx2(geo, palette, begin, end, positions, normals);
+	} else {
+		SkinRangeDefault(geo, palette, begin, end, positions, normals);
+	}
+}
+
+const char* CpuSkinning::GetKernelName()
+{
+	if (use_avx2()) {
+		return "avx2";
+	}
+#if defined(MODEL_SKIN_SSE)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+}
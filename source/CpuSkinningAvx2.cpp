@@ -0,0 +1,81 @@
+// Built with AVX2 and FMA where the compiler can target them, see
+// CMakeLists.txt. Only called after CpuSkinning checked the CPU at runtime.
+
+#include "CpuSkinningKernel.h"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+
+#include <immintrin.h>
+
+namespace
+{
+
+// sm::mat4 is column major, a register holds two columns: lo c0|c1, hi c2|c3
+void skin_vertex_avx2(const sm::mat4* palette, const SkinWeights& sw, const float* pos,
+	                  const float* nor, sm::vec3& dst_pos, sm::vec3* dst_nor)
+{
+	__m256 lo = _mm256_setzero_ps();
+	__m256 hi = _mm256_setzero_ps();
+	for (int i = 0; i < sw.n; ++i)
+	{
+		const float* m = palette[sw.idx[i]].x;
+		const __m256 w = _mm256_set1_ps(sw.w[i]);
+		lo = _mm256_fmadd_ps(_mm256_loadu_ps(m), w, lo);
+		hi = _mm256_fmadd_ps(_mm256_loadu_ps(m + 8), w, hi);
+	}
+
+	// x * c0 + y * c1 + z * c2 + c3
+	__m256 xy = _mm256_setr_ps(pos[0], pos[0], pos[0], pos[0], pos[1], pos[1], pos[1], pos[1]);
+	__m256 z1 = _mm256_setr_ps(pos[2], pos[2], pos[2], pos[2], 1, 1, 1, 1);
+	__m256 sum = _mm256_fmadd_ps(lo, xy, _mm256_mul_ps(hi, z1));
+	__m128 p = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+
+	float out[4];
+	_mm_storeu_ps(out, p);
+	dst_pos.x = out[0]; dst_pos.y = out[1]; dst_pos.z = out[2];
+
+	if (dst_nor)
+	{
+		xy = _mm256_setr_ps(nor[0], nor[0], nor[0], nor[0], nor[1], nor[1], nor[1], nor[1]);
+		z1 = _mm256_setr_ps(nor[2], nor[2], nor[2], nor[2], 0, 0, 0, 0);
+		sum = _mm256_fmadd_ps(lo, xy, _mm256_mul_ps(hi, z1));
+		p = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+
+		_mm_storeu_ps(out, p);
+		dst_nor->x = out[0]; dst_nor->y = out[1]; dst_nor->z = out[2];
+		normalize(*dst_nor);
+	}
+}
+
+}
+
+namespace model
+{
+
+const bool SKIN_AVX2_BUILT = true;
+
+void SkinRangeAvx2(const MeshGeometry& geo, const sm::mat4* palette,
+	               size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals)
+{
+	skin_range(geo, palette, begin, end, positions, normals, skin_vertex_avx2);
+}
+
+}
+
+#else
+
+namespace model
+{
+
+const bool SKIN_AVX2_BUILT = false;
+
+// not selected by CpuSkinning, still correct if called
+void SkinRangeAvx2(const MeshGeometry& geo, const sm::mat4* palette,
+	               size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals)
+{
+	SkinRangeDefault(geo, palette, begin, end, positions, normals);
+}
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+#pragma once
+
+// Private to CpuSkinning.cpp and CpuSkinningAvx2.cpp, which are built for
+// different instruction sets. Helpers have internal linkage, so neither
+// one can end up calling the other's copy.
+
+#include "model/MeshGeometry.h"
+#include "model/typedef.h"
+
+#include <SM_Vector.h>
+#include <SM_Matrix.h>
+
+#include <algorithm>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+namespace model
+{
+
+// CpuSkinning.cpp, the SSE or scalar kernel
+void SkinRangeDefault(const MeshGeometry& geo, const sm::mat4* palette,
+	size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals);
+
+// CpuSkinningAvx2.cpp, SKIN_AVX2_BUILT is false where the compiler can't
+// target AVX2 and FMA, SkinRangeAvx2() then forwards to SkinRangeDefault()
+extern const bool SKIN_AVX2_BUILT;
+void SkinRangeAvx2(const MeshGeometry& geo, const sm::mat4* palette,
+	size_t begin, size_t end, sm::vec3* positions, sm::vec3* normals);
+
+}
+
+namespace
+{
+
+// pos3 [normal3] ... indices4 weights4, the skin data is always last
+const size_t NORMAL_OFFSET = sizeof(float) * 3;
+const size_t SKIN_TAIL     = sizeof(uint32_t) * 2;
+
+struct SkinWeights
+{
+	uint8_t idx[4];
+	float   w[4];
+	int     n;
+};
+
+// false for vertices without weights, left unskinned
+bool load_weights(const uint8_t* vert, size_t stride, SkinWeights& sw)
+{
+	const uint8_t* skin = vert + stride - SKIN_TAIL;
+	memcpy(sw.idx, skin, 4);
+
+	const uint8_t* wb = skin + 4;
+	const int sum = wb[0] + wb[1] + wb[2] + wb[3];
+	if (sum == 0) {
+		return false;
+	}
+
+	const float inv = 1.0f / sum;
+	sw.n = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (wb[i] == 0) {
+			continue;
+		}
+		sw.idx[sw.n] = sw.idx[i];
+		sw.w[sw.n] = wb[i] * inv;
+		++sw.n;
+	}
+	return true;
+}
+
+void normalize(sm::vec3& n)
+{
+	const float len2 = n.x * n.x + n.y * n.y + n.z * n.z;
+	if (len2 > 0)
+	{
+		const float inv = 1.0f / sqrtf(len2);
+		n.x *= inv; n.y *= inv; n.z *= inv;
+	}
+}
+
+// vertices [begin, end) with one kernel's skin_vertex(palette, sw, pos, nor, dst_pos, dst_nor)
+template <typename SkinVertex>
+void skin_range(const model::MeshGeometry& geo, const sm::mat4* palette, size_t begin, size_t end,
+	            sm::vec3* positions, sm::vec3* normals, SkinVertex skin_vertex)
+{
+	if (!geo.vert_buf || !positions) {
+		return;
+	}
+	end = std::min(end, geo.n_vert);
+
+	const bool skinned = (geo.vertex_type & model::VERTEX_FLAG_SKINNED) != 0 && palette;
+	if (!(geo.vertex_type & model::VERTEX_FLAG_NORMALS)) {
+		normals = nullptr;
+	}
+
+	const size_t stride = geo.vert_stride;
+	assert(!skinned || stride >= NORMAL_OFFSET + SKIN_TAIL);
+
+	SkinWeights sw;
+	for (size_t i = begin; i < end; ++i)
+	{
+		const uint8_t* vert = geo.vert_buf + i * stride;
+		const float* pos = reinterpret_cast<const float*>(vert);
+		const float* nor = reinterpret_cast<const float*>(vert + NORMAL_OFFSET);
+		sm::vec3* dst_nor = normals ? &normals[i] : nullptr;
+
+		if (skinned && load_weights(vert, stride, sw))
+		{
+			skin_vertex(palette, sw, pos, nor, positions[i], dst_nor);
+		}
+		else
+		{
+			positions[i].x = pos[0]; positions[i].y = pos[1]; positions[i].z = pos[2];
+			if (dst_nor) {
+				dst_nor->x = nor[0]; dst_nor->y = nor[1]; dst_nor->z = nor[2];
+			}
+		}
+	}
+}
+
+}
@@ -136,16 +136,9 @@ bool FbxLoader::Load(const ur::Device& dev, Model& model,
         ext->SetNodes(nodes);
 
         // bones
-		auto& sk_nodes = ext->GetNodes();
 		for (auto& mesh : model.meshes) {
 			for (auto& bone : mesh->geometry.bones) {
-				bone.node = -1;
-				for (int i = 0, n = sk_nodes.size(); i < n; ++i) {
-					if (sk_nodes[i]->name == bone.name) {
-						bone.node = i;
-						break;
-					}
-				}
+				bone.node = ext->QueryNodeByName(bone.name);
 			}
 		}
 
@@ -4,15 +4,13 @@
 #include "model/gltf/Model.h"
 
 #include <unirender/Device.h>
-#include <unirender/VertexBuffer.h>
 #include <unirender/VertexArray.h>
-#include <unirender/ComponentDataType.h>
-#include <unirender/VertexInputAttribute.h>
-#include <unirender/IndexBuffer.h>
 #include <unirender/TextureDescription.h>
 #include <unirender/TextureSampler.h>
 #include <unirender/Texture.h>
 
+#include <filesystem>
+
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <tiny_gltf.h>
@@ -44,48 +42,50 @@ namespace model
 
 bool GltfLoader::Load(const ur::Device& dev, Model& model, const std::string& filepath)
 {
-	tinygltf::Model t_model;
-	tinygltf::TinyGLTF loader;
-	std::string err;
-	std::string warn;
-
-	bool ret = loader.LoadASCIIFromFile(&t_model, &err, &warn, filepath);
-	//bool ret = loader.LoadBinaryFromFile(&t_model, &err, &warn, filepath); // for binary glTF(.glb)
-
-	if (!warn.empty()) {
-		printf("Warn: %s\n", warn.c_str());
+	StagedModel staged;
+	if (!LoadModel(model, staged, filepath)) {
+		return false;
 	}
+	staged.UploadResources(dev, model);
+	return true;
+}
 
-	if (!err.empty()) {
-		printf("Err: %s\n", err.c_str());
+bool GltfLoader::Load(StagedModel& staged, const std::string& filepath)
+{
+	if (!staged.model) {
+		return false;
 	}
+	return LoadModel(*staged.model, staged, filepath);
+}
 
-	if (!ret) {
-		printf("Failed to parse glTF\n");
+bool GltfLoader::Load(const ur::Device& dev, gltf::Model& model, const std::string& filepath)
+{
+	tinygltf::Model t_model;
+	if (!ParseFile(t_model, filepath)) {
 		return false;
 	}
 
-	LoadTextures(dev, model, t_model);
-
-	LoadMaterials(dev, model, t_model);
-
-	sm::cube aabb;
-	LoadMeshes(dev, model, t_model, aabb);
+	auto samplers = LoadSamplers(dev, t_model);
+	auto textures = LoadTextures(dev, t_model, samplers);
+	auto materials = LoadMaterials(dev, t_model, textures);
+	auto meshes = LoadMeshes(dev, t_model, materials);
+	auto nodes = LoadNodes(dev, t_model, meshes);
+	auto scenes = LoadScenes(dev, t_model, nodes);
 
-	LoadNodes(dev, model, t_model);
+	model.scenes = scenes;
+	model.scene = scenes[t_model.defaultScene];
 
 	return true;
 }
 
-bool GltfLoader::Load(const ur::Device& dev, gltf::Model& model, const std::string& filepath)
+bool GltfLoader::ParseFile(tinygltf::Model& model, const std::string& filepath)
 {
-	tinygltf::Model t_model;
 	tinygltf::TinyGLTF loader;
 	std::string err;
 	std::string warn;
 
-	bool ret = loader.LoadASCIIFromFile(&t_model, &err, &warn, filepath);
-	//bool ret = loader.LoadBinaryFromFile(&t_model, &err, &warn, filepath); // for binary glTF(.glb)
+	bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filepath);
+	//bool ret = loader.LoadBinaryFromFile(&model, &err, &warn, filepath); // for binary glTF(.glb)
 
 	if (!warn.empty()) {
 		printf("Warn: %s\n", warn.c_str());
@@ -100,33 +100,51 @@ bool GltfLoader::Load(const ur::Device& dev, gltf::Model& model, const std::stri
 		return false;
 	}
 
-	auto samplers = LoadSamplers(dev, t_model);
-	auto textures = LoadTextures(dev, t_model, samplers);
-	auto materials = LoadMaterials(dev, t_model, textures);
-	auto meshes = LoadMeshes(dev, t_model, materials);
-	auto nodes = LoadNodes(dev, t_model, meshes);
-	auto scenes = LoadScenes(dev, t_model, nodes);
+	return true;
+}
 
-	model.scenes = scenes;
-	model.scene = scenes[t_model.defaultScene];
+bool GltfLoader::LoadModel(Model& model, StagedModel& staged, const std::string& filepath)
+{
+	tinygltf::Model t_model;
+	if (!ParseFile(t_model, filepath)) {
+		return false;
+	}
+
+	LoadTextures(staged, model, t_model, std::filesystem::path(filepath).parent_path().string());
+
+	LoadMaterials(model, t_model);
+
+	LoadMeshes(staged, model, t_model);
+
+	LoadNodes(model, t_model);
 
 	return true;
 }
 
-std::shared_ptr<ur::Texture> GltfLoader::LoadTexture(const ur::Device& dev, const tinygltf::Image& img)
+bool GltfLoader::GetTextureFormat(const tinygltf::Image& img, ur::TextureFormat& format)
 {
-	ur::TextureFormat tf;
 	if (img.component == 4 && img.bits == 8 && img.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE)
 	{
-		tf = ur::TextureFormat::RGBA8;
+		format = ur::TextureFormat::RGBA8;
 	}
 	else if (img.component == 4 && img.bits == 16 && img.pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
 	{
-		tf = ur::TextureFormat::RGBA16;
+		format = ur::TextureFormat::RGBA16;
 	}
 	else
+	{
+		return false;
+	}
+	return true;
+}
+
+std::shared_ptr<ur::Texture> GltfLoader::LoadTexture(const ur::Device& dev, const tinygltf::Image& img)
+{
+	ur::TextureFormat tf;
+	if (!GetTextureFormat(img, tf))
 	{
 		assert(0);
+		return nullptr;
 	}
 
 	ur::TextureDescription desc;
@@ -137,8 +155,8 @@ std::shared_ptr<ur::Texture> GltfLoader::LoadTexture(const ur::Device& dev, cons
 	return dev.CreateTexture(desc, img.image.data());
 }
 
-std::shared_ptr<ur::VertexArray> 
-GltfLoader::LoadVertexArray(const ur::Device& dev, const tinygltf::Model& model, const tinygltf::Primitive& prim, unsigned int& vertex_type)
+void GltfLoader::LoadPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& prim,
+	                           MeshGeometry& geo, StagedModel::MeshBuffers& buffers)
 {
 	int floats_per_vertex = 3;
 
@@ -247,124 +265,89 @@ GltfLoader::LoadVertexArray(const ur::Device& dev, const tinygltf::Model& model,
 		}
 	}
 
-	auto mesh = std::make_unique<Model::Mesh>();
-
-	auto va = dev.CreateVertexArray();
+	geo.vert_buf    = buf;
+	geo.vert_stride = sizeof(float) * floats_per_vertex;
+	geo.n_vert      = positions.size();
 
 	// indices
-	int indices_num = 0;
 	{
 		const tinygltf::Accessor& accessor = model.accessors[prim.indices];
 		const tinygltf::BufferView& buffer_view = model.bufferViews[accessor.bufferView];
 		const tinygltf::Buffer& buffer = model.buffers[buffer_view.buffer];
 
-		const tinygltf::Buffer& idx_buffer = model.buffers[buffer_view.buffer];
 		assert(accessor.type == TINYGLTF_TYPE_SCALAR);
 		if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
 		{
-			std::vector<unsigned short> indices;
 			const unsigned short* src_indices = reinterpret_cast<const unsigned short*>(&buffer.data[buffer_view.byteOffset + accessor.byteOffset]);
-			indices.resize(accessor.count);
-			for (size_t i = 0; i < accessor.count; ++i) {
-				indices[i] = src_indices[i];
-			}
-			auto ibuf_sz = sizeof(uint16_t) * indices.size();
-			auto ibuf = dev.CreateIndexBuffer(ur::BufferUsageHint::StaticDraw, ibuf_sz);
-			ibuf->ReadFromMemory(indices.data(), ibuf_sz, 0);
-			ibuf->SetDataType(ur::IndexBufferDataType::UnsignedShort);
-			va->SetIndexBuffer(ibuf);
-			indices_num = indices.size();
+			buffers.indices.assign(src_indices, src_indices + accessor.count);
 		}
 		else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
 		{
-			std::vector<unsigned int> indices;
 			const unsigned int* src_indices = reinterpret_cast<const unsigned int*>(&buffer.data[buffer_view.byteOffset + accessor.byteOffset]);
-			indices.resize(accessor.count);
-			for (size_t i = 0; i < accessor.count; ++i) {
-				indices[i] = src_indices[i];
-			}
-			auto ibuf_sz = sizeof(uint32_t) * indices.size();
-			auto ibuf = dev.CreateIndexBuffer(ur::BufferUsageHint::StaticDraw, ibuf_sz);
-			ibuf->ReadFromMemory(indices.data(), ibuf_sz, 0);
-			ibuf->SetDataType(ur::IndexBufferDataType::UnsignedInt);
-			va->SetIndexBuffer(ibuf);
-			indices_num = indices.size();
+			buffers.indices32.assign(src_indices, src_indices + accessor.count);
 		}
 		else
 		{
 			assert(0);
 		}
-
-		auto vbuf_sz = sizeof(float) * floats_per_vertex * positions.size();
-		auto vbuf = dev.CreateVertexBuffer(ur::BufferUsageHint::StaticDraw, vbuf_sz);
-		vbuf->ReadFromMemory(buf, vbuf_sz, 0);
-		va->SetVertexBuffer(vbuf);
 	}
 
-	std::vector<std::shared_ptr<ur::VertexInputAttribute>> vbuf_attrs;
-
-	int stride = 0;
-	// pos
-	stride += 4 * 3;
-	// normal
 	if (has_normal) {
-		stride += 4 * 3;
+		geo.vertex_type |= VERTEX_FLAG_NORMALS;
 	}
-	// texcoord
 	if (has_texcoord0) {
-		stride += 4 * 2;
+		geo.vertex_type |= VERTEX_FLAG_TEXCOORDS0;
 	}
 	if (has_texcoord1) {
-		stride += 4 * 2;
+		geo.vertex_type |= VERTEX_FLAG_TEXCOORDS1;
 	}
+	int stride = 0;
+	buffers.attrs = StagedModel::BuildVertexAttrs(geo.vertex_type, stride);
+	assert(static_cast<size_t>(stride) == geo.vert_stride);
+}
 
-	int attr_loc = 0;
-	int offset = 0;
-	// pos
-	vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-		attr_loc++, ur::ComponentDataType::Float, 3, offset, stride));
-	offset += 4 * 3;
-	// normal
-	if (has_normal)
-	{
-		vertex_type |= VERTEX_FLAG_NORMALS;
-		vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::Float, 3, offset, stride));
-		offset += 4 * 3;
-	}
-	// texcoord
-	if (has_texcoord0)
-	{
-		vertex_type |= VERTEX_FLAG_TEXCOORDS0;
-		vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::Float, 2, offset, stride));
-		offset += 4 * 2;
-	}
-	if (has_texcoord1)
-	{
-		vertex_type |= VERTEX_FLAG_TEXCOORDS1;
-		vbuf_attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
-			attr_loc++, ur::ComponentDataType::Float, 2, offset, stride));
-		offset += 4 * 2;
-	}
-
-	va->SetVertexBufferAttrs(vbuf_attrs);
-
-	va->GetIndexBuffer()->SetCount(indices_num);
+std::shared_ptr<ur::VertexArray> 
+GltfLoader::LoadVertexArray(const ur::Device& dev, const tinygltf::Model& model, const tinygltf::Primitive& prim, unsigned int& vertex_type)
+{
+	MeshGeometry geo;
+	StagedModel::MeshBuffers buffers;
+	LoadPrimitive(model, prim, geo, buffers);
 
-	delete[] buf;
+	vertex_type |= geo.vertex_type;
 
-	return va;
+	return StagedModel::CreateVertexArray(dev, geo, buffers);
 }
 
-void GltfLoader::LoadTextures(const ur::Device& dev, Model& dst, const tinygltf::Model& src)
+void GltfLoader::LoadTextures(StagedModel& staged, Model& dst, tinygltf::Model& src, const std::string& dir)
 {
-	for (auto& img : src.images) {
-		dst.textures.push_back({ img.uri, LoadTexture(dev, img) });
+	for (auto& img : src.images)
+	{
+		// embedded images have no file
+		std::string path = img.uri;
+		if (!path.empty() && path.compare(0, 5, "data:") != 0) {
+			path = (std::filesystem::path(dir) / std::filesystem::path(path)).lexically_normal().string();
+		}
+
+		const int tex = static_cast<int>(dst.textures.size());
+		dst.textures.push_back({ path, nullptr });
+
+		StagedModel::Texture t;
+		if (img.image.empty() || !GetTextureFormat(img, t.image.format)) {
+			continue;
+		}
+		t.tex = tex;
+		t.image.width  = img.width;
+		t.image.height = img.height;
+
+		// no copy, the vector is kept alive by the image
+		auto pixels = std::make_shared<std::vector<unsigned char>>(std::move(img.image));
+		t.image.pixels = std::shared_ptr<uint8_t>(pixels, pixels->data());
+
+		staged.textures.push_back(std::move(t));
 	}
 }
 
-void GltfLoader::LoadMaterials(const ur::Device& dev, Model& dst, const tinygltf::Model& src)
+void GltfLoader::LoadMaterials(Model& dst, const tinygltf::Model& src)
 {
 	auto get_img_idx = [](const tinygltf::Model& model, int tex_idx)->int
 	{
@@ -389,29 +372,32 @@ void GltfLoader::LoadMaterials(const ur::Device& dev, Model& dst, const tinygltf
 	}
 }
 
-void GltfLoader::LoadMeshes(const ur::Device& dev, Model& dst, const tinygltf::Model& src, sm::cube& aabb)
+void GltfLoader::LoadMeshes(StagedModel& staged, Model& dst, const tinygltf::Model& src)
 {
 	for (auto& mesh : src.meshes)
 	{
 		for (auto& prim : mesh.primitives)
 		{
-			unsigned int vertex_type = 0;
-			auto va = LoadVertexArray(dev, src, prim, vertex_type);
-
 			auto mesh = std::make_unique<Model::Mesh>();
-			mesh->geometry.vertex_type = vertex_type;
+			mesh->material = prim.material;
+			auto& geo = mesh->geometry;
+
+			StagedModel::MeshBuffers buffers;
+			buffers.mesh = static_cast<int>(dst.meshes.size());
+			LoadPrimitive(src, prim, geo, buffers);
 
-			mesh->geometry.vertex_array = va;
-			int idx = mesh->geometry.sub_geometries.size();
-			mesh->geometry.sub_geometries.push_back(SubmeshGeometry(true, va->GetIndexBuffer()->GetCount(), 0));
-			mesh->geometry.sub_geometry_materials.push_back(idx);
+			geo.sub_geometries.push_back(SubmeshGeometry(true, buffers.GetIndexCount(), 0));
+			if (prim.material >= 0) {
+				geo.sub_geometry_materials.push_back(prim.material);
+			}
 
+			staged.meshes.push_back(std::move(buffers));
 			dst.meshes.push_back(std::move(mesh));
 		}
 	}
 }
 
-void GltfLoader::LoadNodes(const ur::Device& dev, Model& dst, const tinygltf::Model& src)
+void GltfLoader::LoadNodes(Model& dst, const tinygltf::Model& src)
 {
 	for (auto& node : src.nodes)
 	{
@@ -528,7 +514,7 @@ GltfLoader::LoadTextures(const ur::Device& dev, const tinygltf::Model& model, co
 		if (src.sampler >= 0) {
 			dst->sampler = samplers[src.sampler];
 		}
-		if (dst->sampler) {
+		if (dst->image && dst->sampler) {
 			dst->image->ApplySampler(dst->sampler);
 		}
 		ret.push_back(dst);
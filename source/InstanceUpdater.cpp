@@ -0,0 +1,64 @@
+#include "model/InstanceUpdater.h"
+#include "model/ModelInstance.h"
+
+namespace
+{
+
+// instances taken per grab, small enough to balance uneven rigs
+const size_t CHUNK_SIZE = 16;
+
+}
+
+namespace model
+{
+
+InstanceUpdater::InstanceUpdater(int thread_count)
+	: m_own_pool(std::make_unique<WorkerPool>(thread_count))
+{
+	m_pool = m_own_pool.get();
+}
+
+InstanceUpdater::InstanceUpdater(WorkerPool& pool)
+	: m_pool(&pool)
+{
+}
+
+InstanceUpdater::~InstanceUpdater()
+{
+}
+
+void InstanceUpdater::UpdateInstances(ModelInstance* const* instances, size_t count, const TimeContext& ctx,
+	                                  const std::function<void(ModelInstance&)>& post_update)
+{
+	m_pool->ParallelFor(count, CHUNK_SIZE, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			instances[i]->Update(ctx);
+			if (post_update) {
+				post_update(*instances[i]);
+			}
+		}
+	});
+}
+
+void InstanceUpdater::UpdateInstances(const std::vector<ModelInstance*>& instances, const TimeContext& ctx,
+	                                  const std::function<void(ModelInstance&)>& post_update)
+{
+	UpdateInstances(instances.data(), instances.size(), ctx, post_update);
+}
+
+void InstanceUpdater::UpdateInstances(const std::vector<ModelInstance*>& instances, float time,
+	                                  const std::function<void(ModelInstance&)>& post_update)
+{
+	TimeContext ctx;
+	ctx.time = time;
+	UpdateInstances(instances.data(), instances.size(), ctx, post_update);
+}
+
+int InstanceUpdater::GetThreadCount() const
+{
+	return m_pool->GetThreadCount();
+}
+
+}
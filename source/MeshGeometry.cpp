@@ -5,7 +5,7 @@ namespace model
 
 MeshGeometry::~MeshGeometry()
 {
-    if (vert_buf) {
+    if (vert_buf && !vert_buf_storage) {
         delete[] vert_buf;
     }
 }
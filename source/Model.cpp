@@ -11,6 +11,7 @@
 #include "model/FbxLoader.h"
 #endif
 #include "model/GltfLoader.h"
+#include "model/CookedModel.h"
 
 #include <guard/check.h>
 
@@ -34,6 +35,8 @@ bool Model::LoadFromFile(const std::string& filepath)
 		return MaxLoader::Load(*dev, *this, filepath);
 	} else if (ext == ".gltf") {
 		return GltfLoader::Load(*dev, *this, filepath);
+	} else if (ext == ".cooked") {
+		return CookedModel::Load(*dev, *this, filepath);
 	}
 #ifndef NO_QUAKE
 	else if (ext == ".mdl") {
@@ -3,6 +3,98 @@
 #include "model/GlobalClock.h"
 #include "model/MorphTargetAnim.h"
 #include "model/SkeletalAnim.h"
+#include "model/ClipSampler.h"
+#include "model/PoseCache.h"
+
+#include <algorithm>
+
+#include <string.h>
+#include <math.h>
+
+namespace
+{
+
+sm::Quaternion quat_conj(const sm::Quaternion& q)
+{
+	sm::Quaternion ret;
+	ret.x = -q.x; ret.y = -q.y; ret.z = -q.z; ret.w = q.w;
+	return ret;
+}
+
+sm::Quaternion quat_mul(const sm::Quaternion& a, const sm::Quaternion& b)
+{
+	sm::Quaternion ret;
+	ret.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	ret.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	ret.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	ret.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	return ret;
+}
+
+sm::vec3 quat_rotate(const sm::Quaternion& q, const sm::vec3& v)
+{
+	// v + 2w(q x v) + 2q x (q x v)
+	const float tx = 2 * (q.y * v.z - q.z * v.y);
+	const float ty = 2 * (q.z * v.x - q.x * v.z);
+	const float tz = 2 * (q.x * v.y - q.y * v.x);
+
+	sm::vec3 ret;
+	ret.x = v.x + q.w * tx + (q.y * tz - q.z * ty);
+	ret.y = v.y + q.w * ty + (q.z * tx - q.x * tz);
+	ret.z = v.z + q.w * tz + (q.x * ty - q.y * tx);
+	return ret;
+}
+
+// shortest path
+sm::Quaternion quat_nlerp(const sm::Quaternion& a, const sm::Quaternion& b, float t)
+{
+	const float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1.0f : 1.0f;
+
+	sm::Quaternion ret;
+	ret.x = a.x + (b.x * sign - a.x) * t;
+	ret.y = a.y + (b.y * sign - a.y) * t;
+	ret.z = a.z + (b.z * sign - a.z) * t;
+	ret.w = a.w + (b.w * sign - a.w) * t;
+
+	const float len2 = ret.x * ret.x + ret.y * ret.y + ret.z * ret.z + ret.w * ret.w;
+	if (len2 > 0)
+	{
+		const float inv = 1.0f / sqrtf(len2);
+		ret.x *= inv; ret.y *= inv; ret.z *= inv; ret.w *= inv;
+	}
+	return ret;
+}
+
+bool is_empty(const sm::cube& c)
+{
+	return c.xmin > c.xmax;
+}
+
+// center and extent through the matrix, tighter than the 8 corners' bound
+// for the same cost
+void combine_trans_aabb(sm::cube& dst, const sm::cube& src, const sm::mat4& mat)
+{
+	const float c[3] = { (src.xmin + src.xmax) * 0.5f, (src.ymin + src.ymax) * 0.5f, (src.zmin + src.zmax) * 0.5f };
+	const float e[3] = { (src.xmax - src.xmin) * 0.5f, (src.ymax - src.ymin) * 0.5f, (src.zmax - src.zmin) * 0.5f };
+
+	float nc[3], ne[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		nc[i] = mat.x[12 + i];
+		ne[i] = 0;
+		for (int j = 0; j < 3; ++j)
+		{
+			const float m = mat.x[j * 4 + i];
+			nc[i] += m * c[j];
+			ne[i] += fabs(m) * e[j];
+		}
+	}
+
+	dst.Combine(sm::vec3(nc[0] - ne[0], nc[1] - ne[1], nc[2] - ne[2]));
+	dst.Combine(sm::vec3(nc[0] + ne[0], nc[1] + ne[1], nc[2] + ne[2]));
+}
+
+}
 
 namespace model
 {
@@ -19,32 +111,32 @@ ModelInstance::ModelInstance(const std::shared_ptr<Model>& m_model, int anim_idx
 		int sz = nodes.size();
 
 		// local trans
-		m_local_trans.reserve(sz);
-		for (int i = 0; i < sz; ++i) {
-			m_local_trans.push_back(nodes[i]->local_trans);
-		}
+		m_local_pose = sk_anim->GetBindPose();
 
 		// global trans
 		CalcGlobalTrans();
 
-		auto& anims = sk_anim->GetAnims();
-		if (m_curr_anim_index >= 0 && m_curr_anim_index < static_cast<int>(anims.size()))
-		{
-			m_channel_idx.reserve(sz);
-			auto& channels = anims[m_curr_anim_index]->channels;
-			for (int i = 0; i < sz; ++i)
-			{
-				int idx = -1;
-				for (int j = 0, m = channels.size(); j < m; ++j) {
-					if (nodes[i]->name == channels[j]->name) {
-						idx = j;
-					}
-				}
-				m_channel_idx.push_back(idx);
-			}
+		// bone trans, big enough for every mesh so CalcBoneMatrices() never grows it
+		size_t max_bones = 0;
+		for (auto& mesh : m_model->meshes) {
+			max_bones = std::max(max_bones, mesh->geometry.bones.size());
+		}
+		m_bone_trans.reserve(max_bones);
 
-			m_last_pos.assign(channels.size(), std::make_tuple(0, 0, 0));
+		// sampled channels, big enough for any clip so blending several fits too
+		size_t max_channels = 0;
+		for (auto& anim : sk_anim->GetAnims()) {
+			max_channels = std::max(max_channels, anim->channels.size());
 		}
+		m_channel_trans.resize(max_channels);
+		m_channel_rot.resize(max_channels);
+		m_channel_scale.resize(max_channels);
+
+		InitPaletteLayout();
+		InitNodeBounds();
+
+		// channel bindings are shared by the clip, see SkeletalAnim::InitChannelBindings()
+		SetCurrAnimIndex(m_curr_anim_index);
 	}
 }
 
@@ -52,20 +144,72 @@ ModelInstance::~ModelInstance()
 {
 }
 
+void ModelInstance::SetCurrAnimIndex(int idx)
+{
+	m_curr_anim_index = idx;
+
+	m_cursors.clear();
+
+	auto anim = GetCurrAnim();
+	if (anim) {
+		m_cursors.resize(anim->channels.size());
+	}
+}
+
 bool ModelInstance::Update()
+{
+	return Update(GlobalClock::Instance()->GetTime());
+}
+
+bool ModelInstance::Update(float time)
+{
+	TimeContext ctx;
+	ctx.time = time;
+	return Update(ctx);
+}
+
+bool ModelInstance::Update(const TimeContext& ctx)
 {
 	if (!m_model->ext) {
 		return false;
 	}
 
+	if (!m_started)
+	{
+		m_last_time  = ctx.time;
+		m_start_time = m_curr_time;
+		m_started = true;
+		return false;
+	}
+
+	m_curr_time += (ctx.time - m_last_time) * ctx.speed * m_play_speed * m_model->anim_speed;
+	m_last_time = ctx.time;
+	const float curr_time = m_curr_time;
+
+	bool dirty = false;
 	switch (m_model->ext->Type())
 	{
 	case EXT_MORPH_TARGET:
-		return UpdateMorphTargetAnim();
+		dirty = UpdateMorphTargetAnim(curr_time);
+		break;
 	case EXT_SKELETAL:
-		return UpdateSkeletalAnim();
+		dirty = UpdateSkeletalAnim(curr_time);
+		break;
 	}
-	return false;
+
+	if (dirty && m_auto_publish) {
+		PublishPose();
+	}
+	return dirty;
+}
+
+void ModelInstance::SetStartTime(float time)
+{
+	if (!m_started) {
+		m_last_time = time;
+	}
+	m_start_time = m_curr_time - (m_last_time - time) * m_play_speed * m_model->anim_speed;
+	m_started = true;
 }
 
 bool ModelInstance::SetFrame(int curr_frame)
@@ -77,210 +221,103 @@ bool ModelInstance::SetFrame(int curr_frame)
 		return false;
 	}
 
-	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
-
-	auto& anims = sk_anim->GetAnims();
-	if (anims.empty()) {
+	auto ext = GetCurrAnim();
+	if (!ext) {
 		return false;
 	}
-	auto& ext = anims[m_curr_anim_index];
 
 	float curr_time = curr_frame / ext->ticks_per_second;
 	if (ext->duration > 0) {
 		curr_time = fmod(curr_time, ext->duration);
 	}
 
-	std::vector<sm::mat4> channels_trans(ext->channels.size());
-
-	// calc anim trans
-	for (int i = 0, n = ext->channels.size(); i < n; ++i)
-	{
-		auto& channel = ext->channels[i];
-
-		// position
-		sm::vec3 position(0, 0, 0);
-		if (!channel->position_keys.empty())
-		{
-			unsigned int frame = 0;
-			while (frame < channel->position_keys.size() - 1)
-			{
-				if (curr_time < channel->position_keys[frame + 1].first) {
-					break;
-				}
-				frame++;
-			}
-
-			unsigned int next_frame = (frame + 1) % channel->position_keys.size();
-			auto& key = channel->position_keys[frame];
-			auto& next_key = channel->position_keys[next_frame];
-			float diff_time = next_key.first- key.first;
-			if (diff_time < 0.0) {
-				diff_time += ext->duration;
-			}
-			if (diff_time > 0)
-			{
-				float factor = float((curr_time - key.first) / diff_time);
-				position = key.second + (next_key.second - key.second) * factor;
-			}
-			else
-			{
-				position = key.second;
-			}
-
-			std::get<0>(m_last_pos[i]) = frame;
-		}
-
-		// rotation
-		sm::Quaternion rotation(1, 0, 0, 0);
-		if (!channel->rotation_keys.empty())
-		{
-			unsigned int frame = 0;
-			while (frame < channel->rotation_keys.size() - 1)
-			{
-				if (curr_time < channel->rotation_keys[frame + 1].first) {
-					break;
-				}
-				frame++;
-			}
-
-			unsigned int next_frame = (frame + 1) % channel->rotation_keys.size();
-			auto& key = channel->rotation_keys[frame];
-			auto& next_key = channel->rotation_keys[next_frame];
-			float diff_time = next_key.first - key.first;
-			if (diff_time < 0.0) {
-				diff_time += ext->duration;
-			}
-			if (diff_time > 0)
-			{
-				float factor = float((curr_time - key.first) / diff_time);
-				rotation.Slerp(key.second, next_key.second, factor);
-			}
-			else
-			{
-				rotation = key.second;
-			}
-
-			std::get<1>(m_last_pos[i]) = frame;
-		}
-
-		// scaling
-		sm::vec3 scaling(0, 0, 0);
-		if (!channel->scaling_keys.empty())
-		{
-			unsigned int frame = 0;
-			while (frame < channel->scaling_keys.size() - 1)
-			{
-				if (curr_time < channel->scaling_keys[frame + 1].first) {
-					break;
-				}
-				frame++;
-			}
-
-			unsigned int next_frame = (frame + 1) % channel->scaling_keys.size();
-			auto& key = channel->scaling_keys[frame];
-			auto& next_key = channel->scaling_keys[next_frame];
-			float diff_time = next_key.first - key.first;
-			if (diff_time < 0.0) {
-				diff_time += ext->duration;
-			}
-			if (diff_time > 0)
-			{
-				float factor = float((curr_time - key.first) / diff_time);
-				scaling = key.second + (next_key.second - key.second) * factor;
-			}
-			else
-			{
-				scaling = key.second;
-			}
+	// update global trans
+	if (!SampleAnim(*ext, curr_time)) {
+		CalcGlobalTrans();
+	}
 
-			std::get<2>(m_last_pos[i]) = frame;
-		}
+	return true;
+}
 
-		sm::mat4 m(rotation);
-        m.c[0][0] *= scaling.x; m.c[1][0] *= scaling.y; m.c[2][0] *= scaling.z; m.c[3][0] = position.x;
-        m.c[0][1] *= scaling.x; m.c[1][1] *= scaling.y; m.c[2][1] *= scaling.z; m.c[3][1] = position.y;
-        m.c[0][2] *= scaling.x; m.c[1][2] *= scaling.y; m.c[2][2] *= scaling.z; m.c[3][2] = position.z;
-        m.c[0][3]  = 0;         m.c[1][3]  = 0;         m.c[2][3]  = 0;         m.c[3][3] = 1;
-		channels_trans[i] = m;
+const std::vector<sm::mat4>& ModelInstance::GetLocalTrans()
+{
+	auto& pose = m_local_pose;
+	m_local_trans.resize(pose.Size());
+	for (size_t i = 0, n = pose.Size(); i < n; ++i) {
+		m_local_trans[i] = SkeletalAnim::ComposeTrans(pose.trans[i], pose.rot[i], pose.scale[i]);
 	}
+	return m_local_trans;
+}
 
-	// update local trans
-	assert(m_channel_idx.size() == m_local_trans.size());
-	for (int i = 0, n = m_channel_idx.size(); i < n; ++i) {
-		if (m_channel_idx[i] >= 0) {
-			m_local_trans[i] = channels_trans[m_channel_idx[i]];
-		}
+void ModelInstance::SetLocalTrans(const std::vector<sm::mat4>& local_trans)
+{
+	assert(local_trans.size() == m_local_pose.Size());
+	auto& pose = m_local_pose;
+	for (size_t i = 0, n = local_trans.size(); i < n; ++i) {
+		SkeletalAnim::DecomposeTrans(local_trans[i], pose.trans[i], pose.rot[i], pose.scale[i]);
 	}
-
-	// update global trans
 	CalcGlobalTrans();
-
-	return true;
 }
 
-void ModelInstance::SetLocalTrans(const std::vector<sm::mat4>& local_trans)
+void ModelInstance::SetLocalPose(const SkeletalAnim::Pose& local_pose)
 {
-	m_local_trans = local_trans;
+	assert(local_pose.Size() == m_local_pose.Size());
+	m_local_pose = local_pose;
 	CalcGlobalTrans();
 }
 
 void ModelInstance::RotateJoint(int idx, const sm::Quaternion& delta)
 {
-	assert(idx >= 0 && idx < static_cast<int>(m_local_trans.size()));
-	m_local_trans[idx] = sm::mat4(delta) * m_local_trans[idx];
-	CalcGlobalTrans();
+	assert(idx >= 0 && idx < static_cast<int>(m_local_pose.Size()));
+	// delta in parent space, turns the offset too
+	m_local_pose.trans[idx] = quat_rotate(delta, m_local_pose.trans[idx]);
+	m_local_pose.rot[idx]   = quat_mul(delta, m_local_pose.rot[idx]);
+	CalcGlobalTrans(idx);
 }
 
 void ModelInstance::TranslateJoint(int idx, const sm::vec3& offset)
 {
-	assert(idx >= 0 && idx < static_cast<int>(m_local_trans.size()));
-	m_local_trans[idx] = sm::mat4::Translated(offset.x, offset.y, offset.z) * m_local_trans[idx];
-	CalcGlobalTrans();
+	assert(idx >= 0 && idx < static_cast<int>(m_local_pose.Size()));
+	m_local_pose.trans[idx] += offset;
+	CalcGlobalTrans(idx);
 }
 
 void ModelInstance::ScaleJoint(int idx, const sm::vec3& scale)
 {
-    assert(idx >= 0 && idx < static_cast<int>(m_local_trans.size()));
-    m_local_trans[idx] = sm::mat4::Scaled(scale.x, scale.y, scale.z) * m_local_trans[idx];
-    CalcGlobalTrans();
+    assert(idx >= 0 && idx < static_cast<int>(m_local_pose.Size()));
+    // in parent space, the scale part is only exact without rotation or for uniform scale
+    auto& t = m_local_pose.trans[idx];
+    auto& s = m_local_pose.scale[idx];
+    t.x *= scale.x; t.y *= scale.y; t.z *= scale.z;
+    s.x *= scale.x; s.y *= scale.y; s.z *= scale.z;
+    CalcGlobalTrans(idx);
 }
 
 void ModelInstance::SetJointRotate(int idx, const sm::mat4& ori_mat, const sm::Quaternion& rotation)
 {
-	auto& d = m_local_trans[idx];
-	d = ori_mat;
-	auto s = sm::mat4(rotation);
-    d.c[0][0] = s.c[0][0]; d.c[1][0] = s.c[1][0]; d.c[2][0] = s.c[2][0];
-    d.c[0][1] = s.c[0][1]; d.c[1][1] = s.c[1][1]; d.c[2][1] = s.c[2][1];
-    d.c[0][2] = s.c[0][2]; d.c[1][2] = s.c[1][2]; d.c[2][2] = s.c[2][2];
-	CalcGlobalTrans();
+	m_local_pose.trans[idx].Set(ori_mat.c[3][0], ori_mat.c[3][1], ori_mat.c[3][2]);
+	m_local_pose.rot[idx] = rotation;
+	m_local_pose.scale[idx].Set(1, 1, 1);
+	CalcGlobalTrans(idx);
 }
 
 void ModelInstance::SetJointRotate(int idx, const sm::Quaternion& rotation)
 {
-	auto& d = m_local_trans[idx];
-	auto s = sm::mat4(rotation);
-    d.c[0][0] = s.c[0][0]; d.c[1][0] = s.c[1][0]; d.c[2][0] = s.c[2][0];
-    d.c[0][1] = s.c[0][1]; d.c[1][1] = s.c[1][1]; d.c[2][1] = s.c[2][1];
-    d.c[0][2] = s.c[0][2]; d.c[1][2] = s.c[1][2]; d.c[2][2] = s.c[2][2];
-	CalcGlobalTrans();
+	m_local_pose.rot[idx] = rotation;
+	m_local_pose.scale[idx].Set(1, 1, 1);
+	CalcGlobalTrans(idx);
 }
 
 void ModelInstance::SetJointTransform(int idx, const sm::Quaternion& rotation, const sm::vec3& translate)
 {
-	sm::vec3 pos, rot, scale;
-	m_local_trans[idx].Decompose(pos, rot, scale);
-
-	auto& s = scale;
-	auto r = sm::mat4(rotation);
-	auto t = translate;
-	t.x /= s.x;
-	t.y /= s.y;
-	t.z /= s.z;
-
-	m_local_trans[idx] = sm::mat4::Translated(t.x, t.y, t.z) * r * sm::mat4::Scaled(s.x, s.y, s.z);
-
-	CalcGlobalTrans();
+	auto& s = m_local_pose.scale[idx];
+	auto& t = m_local_pose.trans[idx];
+	t.x = translate.x / s.x;
+	t.y = translate.y / s.y;
+	t.z = translate.z / s.z;
+	m_local_pose.rot[idx] = rotation;
+
+	CalcGlobalTrans(idx);
 }
 
 void ModelInstance::ResetToTPose()
@@ -288,260 +325,701 @@ void ModelInstance::ResetToTPose()
 	if (m_model->ext->Type() == EXT_SKELETAL)
 	{
 		auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
-		auto& nodes = sk_anim->GetNodes();
-		assert(nodes.size() == m_local_trans.size());
-		for (int i = 0, n = nodes.size(); i < n; ++i)
-		{
-			sm::vec3 pos, rot, scale;
-			nodes[i]->local_trans.Decompose(pos, rot, scale);
-
-			auto& d = m_local_trans[i];
-            d.c[0][0] = scale.x; d.c[1][0] = 0;       d.c[2][0] = 0;       d.c[3][0] = pos.x;
-            d.c[0][1] = 0;       d.c[1][1] = scale.y; d.c[2][1] = 0;       d.c[3][1] = pos.y;
-            d.c[0][2] = 0;       d.c[1][2] = 0;       d.c[2][2] = scale.z; d.c[3][2] = pos.z;
-            d.c[0][3] = 0;       d.c[1][3] = 0;       d.c[2][3] = 0;       d.c[3][3] = 1;
-		}
+		auto& bind = sk_anim->GetBindPose();
+		assert(bind.Size() == m_local_pose.Size());
+		m_local_pose.trans = bind.trans;
+		m_local_pose.scale = bind.scale;
+		std::fill(m_local_pose.rot.begin(), m_local_pose.rot.end(), sm::Quaternion());
 		CalcGlobalTrans();
 	}
 }
 
+void ModelInstance::CrossFade(int anim_idx, float fade_time)
+{
+	if (fade_time <= 0 || !GetCurrAnim() || !GetAnim(anim_idx))
+	{
+		SetCurrAnimIndex(anim_idx);
+		return;
+	}
+
+	if (m_fade_from.anim >= 0 || m_fade_frozen)
+	{
+		// both clips of the running fade would jump, fade out of the blend
+		// so far instead and keep the shown pose until the next Update()
+		SkeletalAnim::Pose shown = m_local_pose;
+		BlendBase(m_curr_time);
+		std::swap(m_local_pose, shown);
+		m_fade_pose = std::move(shown);
+		m_fade_from.anim = -1;
+		m_fade_frozen = true;
+	}
+	else
+	{
+		m_fade_from.anim       = m_curr_anim_index;
+		m_fade_from.start_time = m_start_time;
+		m_fade_from.cursors.swap(m_cursors);
+	}
+
+	m_fade_start = m_curr_time;
+	m_fade_time  = fade_time;
+
+	SetCurrAnimIndex(anim_idx);
+	m_start_time = m_curr_time;
+}
+
+int ModelInstance::AddLayer(int anim_idx, BlendMode mode, float weight,
+	                        const std::shared_ptr<const std::vector<float>>& node_mask)
+{
+	auto anim = GetAnim(anim_idx);
+	if (!anim) {
+		return -1;
+	}
+
+	AnimLayer layer;
+	layer.id             = m_next_layer_id++;
+	layer.src.anim       = anim_idx;
+	layer.src.start_time = m_curr_time;
+	layer.src.cursors.resize(anim->channels.size());
+	layer.mode      = mode;
+	layer.weight    = weight;
+	layer.node_mask = node_mask;
+	assert(!node_mask || node_mask->size() == m_local_pose.Size());
+
+	if (mode == BlendMode::Additive)
+	{
+		std::vector<ClipSampler::Cursor> cursors(anim->channels.size());
+		auto& ref = layer.ref;
+		ref.Resize(anim->channels.size());
+		anim->sampler->Sample(0, cursors.data(), ref.trans.data(), ref.rot.data(), ref.scale.data());
+	}
+
+	const int id = layer.id;
+	m_layers.push_back(std::move(layer));
+
+	return id;
+}
+
+void ModelInstance::SetLayerWeight(int layer_id, float weight)
+{
+	auto itr = std::find_if(m_layers.begin(), m_layers.end(),
+		[layer_id](const AnimLayer& layer) { return layer.id == layer_id; });
+	if (itr != m_layers.end()) {
+		itr->weight = weight;
+	}
+}
+
+void ModelInstance::RemoveLayer(int layer_id)
+{
+	auto itr = std::find_if(m_layers.begin(), m_layers.end(),
+		[layer_id](const AnimLayer& layer) { return layer.id == layer_id; });
+	if (itr != m_layers.end()) {
+		m_layers.erase(itr);
+	}
+}
+
 void ModelInstance::SetModelExt(std::unique_ptr<ModelExtend>& ext)
 {
     m_ext = std::move(ext);
 }
 
-bool ModelInstance::UpdateMorphTargetAnim()
+bool ModelInstance::UpdateMorphTargetAnim(float curr_time)
 {
-	float curr_time = GlobalClock::Instance()->GetTime() * m_model->anim_speed;
-	if (m_start_time == 0)
-	{
-		m_start_time = curr_time;
-		m_last_time = 0;
+	auto ext = static_cast<const MorphTargetAnim*>(m_model->ext.get());
+	m_morph_state = ext->CalcState(CalcClipTime(curr_time - m_start_time, ext->GetDuration()));
+
+	return true;
+}
+
+bool ModelInstance::UpdateSkeletalAnim(float curr_time)
+{
+	auto ext = GetCurrAnim();
+	if (!ext) {
 		return false;
 	}
 
-	auto ext = static_cast<MorphTargetAnim*>(m_model->ext.get());
-	if (ext->GetNumFrames() == 1)
+	if (m_fade_from.anim >= 0 || m_fade_frozen || !m_layers.empty())
 	{
-		ext->SetFrame(0);
-		ext->SetBlend(0);
+		BlendAnims(curr_time);
+		CalcGlobalTrans();
+		return true;
 	}
-	else
+
+	++m_lod_stats.updates;
+	if (m_lod.update_interval > 1 && (m_lod_frame++ % m_lod.update_interval) != 0) {
+		return UpdateLodPose(curr_time);
+	}
+	++m_lod_stats.full_updates;
+
+	const float raw_time = curr_time;
+	curr_time = CalcClipTime(curr_time - m_start_time, ext->duration);
+
+	// update global trans
+	if (SampleAnim(*ext, curr_time))
+	{
+		// model space cache, no local pose to blend
+		m_lod_has_prev = false;
+		return true;
+	}
+	CalcGlobalTrans();
+
+	if (m_lod.update_interval > 1 && m_lod.blend != LodBlend::Hold)
 	{
-		float f_frame = (curr_time - m_start_time) * ext->GetFps();
-		int frame = static_cast<int>(f_frame) % ext->GetNumFrames();
-		ext->SetFrame(frame);
-		float blend = f_frame - std::floor(f_frame);
-		ext->SetBlend(blend);
+		m_lod_prev.trans.swap(m_lod_curr.trans);
+		m_lod_prev.rot.swap(m_lod_curr.rot);
+		m_lod_prev.scale.swap(m_lod_curr.scale);
+		m_lod_prev_time = m_lod_curr_time;
+		m_lod_has_prev = m_lod_curr.Size() == m_local_pose.Size();
+
+		m_lod_curr = m_local_pose;
+		m_lod_curr_time = raw_time;
+
+		// keep showing the lagged pose, or it would jump ahead and back
+		if (m_lod.blend == LodBlend::Interpolate) {
+			UpdateLodPose(raw_time);
+		}
 	}
 
 	return true;
 }
 
-bool ModelInstance::UpdateSkeletalAnim()
+void ModelInstance::SetAnimLod(const AnimLod& lod)
 {
-	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
+	m_lod = lod;
+	m_lod.tier = std::min(std::max(lod.tier, 0), SkeletalAnim::MAX_LOD_TIER);
+	m_lod.update_interval = std::max(lod.update_interval, 1);
 
-	auto& anims = sk_anim->GetAnims();
-	if (m_curr_anim_index < 0 || m_curr_anim_index >= static_cast<int>(anims.size())) {
+	m_lod_frame = m_lod.phase;
+	m_lod_has_prev = false;
+	m_lod_curr.Resize(0);
+}
+
+bool ModelInstance::UpdateLodPose(float curr_time)
+{
+	const float span = m_lod_curr_time - m_lod_prev_time;
+	if (m_lod.blend == LodBlend::Hold || !m_lod_has_prev || span <= 0) {
 		return false;
 	}
 
-	float curr_time = GlobalClock::Instance()->GetTime() * m_model->anim_speed;
-	if (m_start_time == 0)
+	float w = (curr_time - m_lod_prev_time) / span;
+	if (m_lod.blend == LodBlend::Interpolate) {
+		w = std::min(w - 1.0f, 1.0f);
+	} else {
+		w = std::min(w, 2.0f);
+	}
+
+	auto& a = m_lod_prev;
+	auto& b = m_lod_curr;
+	for (size_t i = 0, n = m_local_pose.Size(); i < n; ++i)
 	{
-		m_start_time = curr_time;
-		m_last_time = 0;
-		return false;
+		m_local_pose.trans[i] = a.trans[i] + (b.trans[i] - a.trans[i]) * w;
+		m_local_pose.rot[i]   = quat_nlerp(a.rot[i], b.rot[i], w);
+		m_local_pose.scale[i] = a.scale[i] + (b.scale[i] - a.scale[i]) * w;
 	}
+	CalcGlobalTrans();
 
-	auto& ext = anims[m_curr_anim_index];
+	return true;
+}
 
-	if (ext->duration > 0) {
-		curr_time = fmod(curr_time - m_start_time, ext->duration);
+const std::vector<sm::mat4>& ModelInstance::CalcBoneMatrices(int node_idx, int mesh_idx) const
+{
+	if (!m_model->ext || m_model->ext->Type() != EXT_SKELETAL) {
+		return m_bone_trans;
 	}
 
-	std::vector<sm::mat4> channels_trans(ext->channels.size());
+	auto& mesh = m_model->meshes[mesh_idx];
+
+	sm::mat4 global_inv_mesh_trans = m_global_trans[node_idx].Inverted();
 
-	// calc anim trans
-	for (int i = 0, n = ext->channels.size(); i < n; ++i)
+	m_bone_trans.resize(mesh->geometry.bones.size());
+	for (size_t i = 0, n = mesh->geometry.bones.size(); i < n; ++i)
 	{
-		auto& channel = ext->channels[i];
+		auto& bone = mesh->geometry.bones[i];
+        if (bone.node < 0) {
+            continue;
+        }
+
+		m_bone_trans[i] = bone.offset_trans * m_global_trans[bone.node] * global_inv_mesh_trans; // mat mul
+
+		float s = m_model->scale;
+		m_bone_trans[i].x[12] *= s;
+		m_bone_trans[i].x[13] *= s;
+		m_bone_trans[i].x[14] *= s;
+	}
+
+	return m_bone_trans;
+}
+
+void ModelInstance::CalcPalettes(float* dst, PaletteFormat fmt)
+{
+	if (m_palette_remap.empty()) {
+		return;
+	}
+
+	UpdateMeshNodeInv();
+	CalcPalettes(m_global_trans.data(), m_mesh_node_inv.data(), m_palette_bone_trans.data(), dst, fmt);
+}
+
+void ModelInstance::CalcPalettes(const PoseSnapshot& pose, float* dst, PaletteFormat fmt) const
+{
+	if (m_palette_remap.empty() || pose.global_trans.size() != m_global_trans.size()) {
+		return;
+	}
+
+	pose.palette_bones.resize(m_palette_bones.size());
+	CalcPalettes(pose.global_trans.data(), pose.mesh_node_inv.data(), pose.palette_bones.data(), dst, fmt);
+}
 
-		// position
-		sm::vec3 position(0, 0, 0);
-		if (!channel->position_keys.empty())
+void ModelInstance::PublishPose()
+{
+	auto& pose = m_pose_buffer.GetBack();
+	pose.global_trans = m_global_trans;
+	pose.time = m_curr_time;
+
+	UpdateMeshNodeInv();
+	pose.mesh_node_inv = m_mesh_node_inv;
+
+	m_pose_buffer.Publish();
+}
+
+sm::cube ModelInstance::CalcPosedAABB() const
+{
+	if (m_node_bounds.empty()) {
+		return m_model->aabb;
+	}
+
+	sm::cube ret = m_static_bound;
+	for (auto& b : m_node_bounds) {
+		combine_trans_aabb(ret, b.second, m_global_trans[b.first]);
+	}
+	return ret;
+}
+
+void ModelInstance::UpdateMeshNodeInv()
+{
+	for (size_t i = 0, n = m_mesh_nodes.size(); i < n; ++i)
+	{
+		auto& trans = m_global_trans[m_mesh_nodes[i]];
+		if (memcmp(trans.x, m_mesh_node_trans[i].x, sizeof(trans.x)) != 0)
 		{
-			unsigned int frame = (curr_time >= m_last_time) ? std::get<0>(m_last_pos[i]) : 0;
-			while (frame < channel->position_keys.size() - 1)
-			{
-				if (curr_time < channel->position_keys[frame + 1].first) {
-					break;
+			m_mesh_node_trans[i] = trans;
+			m_mesh_node_inv[i] = trans.Inverted();
+		}
+	}
+}
+
+void ModelInstance::CalcPalettes(const sm::mat4* global_trans, const sm::mat4* mesh_node_inv,
+	                             sm::mat4* bone_trans, float* dst, PaletteFormat fmt) const
+{
+	const float s = m_model->scale;
+	for (size_t i = 0, n = m_palette_bones.size(); i < n; ++i)
+	{
+		auto& bone = m_palette_bones[i];
+		auto& mat = bone_trans[i];
+		mat = bone.offset_trans * global_trans[bone.node] * mesh_node_inv[bone.mesh_node]; // mat mul
+		mat.x[12] *= s;
+		mat.x[13] *= s;
+		mat.x[14] *= s;
+	}
+
+	const sm::mat4 identity;
+	for (auto idx : m_palette_remap)
+	{
+		auto& mat = idx < 0 ? identity : bone_trans[idx];
+		if (fmt == PaletteFormat::Mat4)
+		{
+			memcpy(dst, mat.x, sizeof(mat.x));
+			dst += 16;
+		}
+		else
+		{
+			for (int row = 0; row < 3; ++row) {
+				for (int col = 0; col < 4; ++col) {
+					*dst++ = mat.c[col][row];
 				}
-				frame++;
 			}
+		}
+	}
+}
 
-			unsigned int next_frame = (frame + 1) % channel->position_keys.size();
-			auto& key = channel->position_keys[frame];
-			auto& next_key = channel->position_keys[next_frame];
-			float diff_time = next_key.first- key.first;
-			if (diff_time < 0.0) {
-				diff_time += ext->duration;
-			}
-			if (diff_time > 0)
-			{
-				float factor = float((curr_time - key.first) / diff_time);
-				position = key.second + (next_key.second - key.second) * factor;
-			}
-			else
-			{
-				position = key.second;
-			}
+bool ModelInstance::SampleAnim(const SkeletalAnim::ModelExtend& anim, float time)
+{
+	// scratch buffers are sized by the constructor
+	auto& trans = m_channel_trans;
+	auto& rot   = m_channel_rot;
+	auto& scale = m_channel_scale;
+	assert(m_cursors.size() == anim.channels.size() && trans.size() >= m_cursors.size());
 
-			std::get<0>(m_last_pos[i]) = frame;
+	const uint8_t* channel_mask = anim.GetLodChannelMask(m_lod.tier);
+
+	if (m_use_pose_cache && anim.pose_cache)
+	{
+		auto& cache = *anim.pose_cache;
+		if (cache.GetSpace() == PoseCache::Space::Model)
+		{
+			assert(m_global_trans.size() == static_cast<size_t>(cache.GetNumItems()));
+			cache.Sample(time, m_global_trans.data());
+			return true;
 		}
+		cache.Sample(time, trans.data(), rot.data(), scale.data());
+	}
+	else
+	{
+		anim.sampler->Sample(time, m_cursors.data(), trans.data(), rot.data(), scale.data(), channel_mask);
+	}
 
-		// rotation
-		sm::Quaternion rotation(1, 0, 0, 0);
-		if (!channel->rotation_keys.empty())
+	// update local pose
+	auto& channel_idx = anim.node_to_channel;
+	assert(channel_idx.size() == m_local_pose.Size());
+	if (channel_mask)
+	{
+		// skipped nodes follow their parent from the bind pose
+		auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
+		auto& bind = sk_anim->GetBindPose();
+		for (int i = 0, n = channel_idx.size(); i < n; ++i)
 		{
-			unsigned int frame = (curr_time >= m_last_time) ? std::get<1>(m_last_pos[i]) : 0;
-			while (frame < channel->rotation_keys.size() - 1)
-			{
-				if (curr_time < channel->rotation_keys[frame + 1].first) {
-					break;
-				}
-				frame++;
+			const int c = channel_idx[i];
+			if (c < 0) {
+				continue;
 			}
 
-			unsigned int next_frame = (frame + 1) % channel->rotation_keys.size();
-			auto& key = channel->rotation_keys[frame];
-			auto& next_key = channel->rotation_keys[next_frame];
-			float diff_time = next_key.first - key.first;
-			if (diff_time < 0.0) {
-				diff_time += ext->duration;
-			}
-			if (diff_time > 0)
+			if (channel_mask[c])
 			{
-				float factor = float((curr_time - key.first) / diff_time);
-				rotation.Slerp(key.second, next_key.second, factor);
+				m_local_pose.trans[i] = trans[c];
+				m_local_pose.rot[i]   = rot[c];
+				m_local_pose.scale[i] = scale[c];
 			}
 			else
 			{
-				rotation = key.second;
+				m_local_pose.trans[i] = bind.trans[i];
+				m_local_pose.rot[i]   = bind.rot[i];
+				m_local_pose.scale[i] = bind.scale[i];
+				++m_lod_stats.nodes_skipped;
 			}
-
-			std::get<1>(m_last_pos[i]) = frame;
 		}
 
-		// scaling
-		sm::vec3 scaling(0, 0, 0);
-		if (!channel->scaling_keys.empty())
+		// what the sampler actually left out, a local pose cache samples all
+		const int n_skipped = m_use_pose_cache && anim.pose_cache ? 0 : anim.sampler->CountSkipped(channel_mask);
+		m_lod_stats.channels_sampled += static_cast<int>(m_cursors.size()) - n_skipped;
+		m_lod_stats.channels_skipped += n_skipped;
+	}
+	else
+	{
+		for (int i = 0, n = channel_idx.size(); i < n; ++i)
 		{
-			unsigned int frame = (curr_time >= m_last_time) ? std::get<2>(m_last_pos[i]) : 0;
-			while (frame < channel->scaling_keys.size() - 1)
+			const int c = channel_idx[i];
+			if (c >= 0)
 			{
-				if (curr_time < channel->scaling_keys[frame + 1].first) {
-					break;
-				}
-				frame++;
+				m_local_pose.trans[i] = trans[c];
+				m_local_pose.rot[i]   = rot[c];
+				m_local_pose.scale[i] = scale[c];
 			}
+		}
+		m_lod_stats.channels_sampled += static_cast<int>(m_cursors.size());
+	}
 
-			unsigned int next_frame = (frame + 1) % channel->scaling_keys.size();
-			auto& key = channel->scaling_keys[frame];
-			auto& next_key = channel->scaling_keys[next_frame];
-			float diff_time = next_key.first - key.first;
-			if (diff_time < 0.0) {
-				diff_time += ext->duration;
-			}
-			if (diff_time > 0)
-			{
-				float factor = float((curr_time - key.first) / diff_time);
-				scaling = key.second + (next_key.second - key.second) * factor;
-			}
-			else
-			{
-				scaling = key.second;
-			}
+	return false;
+}
+
+void ModelInstance::BlendAnims(float curr_time)
+{
+	BlendBase(curr_time);
 
-			std::get<2>(m_last_pos[i]) = frame;
+	for (auto& layer : m_layers)
+	{
+		auto anim = GetAnim(layer.src.anim);
+		if (!anim || layer.weight <= 0) {
+			continue;
 		}
 
-		sm::mat4 m(rotation);
-        m.c[0][0] *= scaling.x; m.c[1][0] *= scaling.y; m.c[2][0] *= scaling.z; m.c[3][0] = position.x;
-        m.c[0][1] *= scaling.x; m.c[1][1] *= scaling.y; m.c[2][1] *= scaling.z; m.c[3][1] = position.y;
-        m.c[0][2] *= scaling.x; m.c[1][2] *= scaling.y; m.c[2][2] *= scaling.z; m.c[3][2] = position.z;
-        m.c[0][3] = 0;         m.c[1][3] = 0;         m.c[2][3] = 0;         m.c[3][3] = 1;
-		channels_trans[i] = m;
+		SampleClip(*anim, layer.src.start_time, layer.src.cursors.data(), curr_time);
+		if (layer.mode == BlendMode::Override) {
+			BlendOverride(*anim, layer.weight, layer.node_mask.get());
+		} else {
+			BlendAdditive(*anim, layer.ref, layer.weight, layer.node_mask.get());
+		}
+	}
+}
+
+void ModelInstance::BlendBase(float curr_time)
+{
+	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
+	m_local_pose = sk_anim->GetBindPose();
+
+	// base clip, cross-faded from the previous one
+	float fade = 1.0f;
+	if (m_fade_from.anim >= 0 || m_fade_frozen)
+	{
+		fade = m_fade_time > 0 ? (curr_time - m_fade_start) / m_fade_time : 1.0f;
+		if (fade >= 1.0f)
+		{
+			m_fade_from.anim = -1;
+			m_fade_frozen = false;
+			fade = 1.0f;
+		}
+		else if (m_fade_frozen)
+		{
+			m_local_pose = m_fade_pose;
+		}
+		else
+		{
+			auto& from = *GetAnim(m_fade_from.anim);
+			SampleClip(from, m_fade_from.start_time, m_fade_from.cursors.data(), curr_time);
+			BlendOverride(from, 1.0f, nullptr);
+		}
+	}
+	if (auto base = GetCurrAnim())
+	{
+		SampleClip(*base, m_start_time, m_cursors.data(), curr_time);
+		BlendOverride(*base, fade, nullptr);
 	}
+}
+
+void ModelInstance::SampleClip(const SkeletalAnim::ModelExtend& anim, float start_time,
+	                           ClipSampler::Cursor* cursors, float curr_time)
+{
+	const float t = CalcClipTime(curr_time - start_time, anim.duration);
+	anim.sampler->Sample(t, cursors, m_channel_trans.data(), m_channel_rot.data(), m_channel_scale.data());
+}
+
+void ModelInstance::BlendOverride(const SkeletalAnim::ModelExtend& anim, float weight, const std::vector<float>* node_mask)
+{
+	auto& channel_idx = anim.node_to_channel;
+	for (int i = 0, n = channel_idx.size(); i < n; ++i)
+	{
+		const int c = channel_idx[i];
+		if (c < 0) {
+			continue;
+		}
+
+		const float w = node_mask ? weight * (*node_mask)[i] : weight;
+		if (w <= 0) {
+			continue;
+		}
 
-	// update local trans
-	assert(m_channel_idx.size() == m_local_trans.size());
-	for (int i = 0, n = m_channel_idx.size(); i < n; ++i) {
-		if (m_channel_idx[i] >= 0) {
-			m_local_trans[i] = channels_trans[m_channel_idx[i]];
+		if (w >= 1)
+		{
+			m_local_pose.trans[i] = m_channel_trans[c];
+			m_local_pose.rot[i]   = m_channel_rot[c];
+			m_local_pose.scale[i] = m_channel_scale[c];
+		}
+		else
+		{
+			m_local_pose.trans[i] = m_local_pose.trans[i] + (m_channel_trans[c] - m_local_pose.trans[i]) * w;
+			m_local_pose.rot[i]   = quat_nlerp(m_local_pose.rot[i], m_channel_rot[c], w);
+			m_local_pose.scale[i] = m_local_pose.scale[i] + (m_channel_scale[c] - m_local_pose.scale[i]) * w;
 		}
 	}
+}
 
-	// update global trans
-	CalcGlobalTrans();
+void ModelInstance::BlendAdditive(const SkeletalAnim::ModelExtend& anim, const SkeletalAnim::Pose& ref,
+	                              float weight, const std::vector<float>* node_mask)
+{
+	auto& channel_idx = anim.node_to_channel;
+	for (int i = 0, n = channel_idx.size(); i < n; ++i)
+	{
+		const int c = channel_idx[i];
+		if (c < 0) {
+			continue;
+		}
 
-	m_last_time = curr_time;
+		const float w = node_mask ? weight * (*node_mask)[i] : weight;
+		if (w <= 0) {
+			continue;
+		}
 
-	return true;
+		m_local_pose.trans[i] += (m_channel_trans[c] - ref.trans[c]) * w;
+
+		auto delta = quat_mul(quat_conj(ref.rot[c]), m_channel_rot[c]);
+		m_local_pose.rot[i] = quat_mul(m_local_pose.rot[i], quat_nlerp(sm::Quaternion(), delta, w));
+
+		auto& s  = m_channel_scale[c];
+		auto& rs = ref.scale[c];
+		auto& d  = m_local_pose.scale[i];
+		d.x *= rs.x != 0 ? 1 + (s.x / rs.x - 1) * w : 1;
+		d.y *= rs.y != 0 ? 1 + (s.y / rs.y - 1) * w : 1;
+		d.z *= rs.z != 0 ? 1 + (s.z / rs.z - 1) * w : 1;
+	}
 }
 
-const std::vector<sm::mat4>& ModelInstance::CalcBoneMatrices(int node_idx, int mesh_idx) const
+void ModelInstance::InitPaletteLayout()
 {
-	if (!m_model->ext || m_model->ext->Type() != EXT_SKELETAL) {
-		return m_bone_trans;
+	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
+	auto& nodes = sk_anim->GetNodes();
+
+	auto& meshes = m_model->meshes;
+	std::vector<int> mesh2node(meshes.size(), -1);
+	for (int i = 0, n = nodes.size(); i < n; ++i) {
+		for (auto mesh : nodes[i]->meshes) {
+			if (mesh >= 0 && mesh < static_cast<int>(meshes.size()) && mesh2node[mesh] < 0) {
+				mesh2node[mesh] = i;
+			}
+		}
 	}
 
-	auto& mesh = m_model->meshes[mesh_idx];
+	// node -> bones using it
+	std::unordered_map<int, std::vector<int>> node2bones;
 
-	sm::mat4 global_inv_mesh_trans = m_global_trans[node_idx].Inverted();
+	m_palette_offsets.assign(meshes.size(), -1);
+	for (size_t i = 0, n = meshes.size(); i < n; ++i)
+	{
+		auto& bones = meshes[i]->geometry.bones;
+		if (bones.empty() || mesh2node[i] < 0) {
+			continue;
+		}
 
-	m_bone_trans.resize(mesh->geometry.bones.size());
-	for (size_t i = 0, n = mesh->geometry.bones.size(); i < n; ++i)
+		int mesh_node = std::find(m_mesh_nodes.begin(), m_mesh_nodes.end(), mesh2node[i]) - m_mesh_nodes.begin();
+		if (mesh_node == static_cast<int>(m_mesh_nodes.size())) {
+			m_mesh_nodes.push_back(mesh2node[i]);
+		}
+
+		m_palette_offsets[i] = m_palette_remap.size();
+		for (auto& bone : bones)
+		{
+			if (bone.node < 0)
+			{
+				m_palette_remap.push_back(-1);
+				continue;
+			}
+
+			auto& shared = node2bones[bone.node];
+			auto itr = std::find_if(shared.begin(), shared.end(), [&](int idx) {
+				auto& b = m_palette_bones[idx];
+				return b.mesh_node == mesh_node
+					&& memcmp(b.offset_trans.x, bone.offset_trans.x, sizeof(bone.offset_trans.x)) == 0;
+			});
+			if (itr != shared.end())
+			{
+				m_palette_remap.push_back(*itr);
+				continue;
+			}
+
+			PaletteBone b;
+			b.node         = bone.node;
+			b.mesh_node    = mesh_node;
+			b.offset_trans = bone.offset_trans;
+			shared.push_back(m_palette_bones.size());
+			m_palette_remap.push_back(m_palette_bones.size());
+			m_palette_bones.push_back(b);
+		}
+	}
+
+	m_mesh_node_trans.resize(m_mesh_nodes.size());
+	m_mesh_node_inv.resize(m_mesh_nodes.size());
+	for (size_t i = 0, n = m_mesh_nodes.size(); i < n; ++i)
 	{
-		auto& bone = mesh->geometry.bones[i];
-        if (bone.node < 0) {
-            continue;
-        }
+		m_mesh_node_trans[i] = m_global_trans[m_mesh_nodes[i]];
+		m_mesh_node_inv[i] = m_mesh_node_trans[i].Inverted();
+	}
+	m_palette_bone_trans.resize(m_palette_bones.size());
+}
 
-		m_bone_trans[i] = bone.offset_trans * m_global_trans[bone.node] * global_inv_mesh_trans; // mat mul
+float ModelInstance::CalcClipTime(float elapsed, float duration) const
+{
+	if (duration <= 0) {
+		return elapsed;
+	}
 
-		float s = m_model->scale;
-		m_bone_trans[i].x[12] *= s;
-		m_bone_trans[i].x[13] *= s;
-		m_bone_trans[i].x[14] *= s;
+	switch (m_loop_mode)
+	{
+	case LoopMode::Once:
+		return std::min(std::max(elapsed, 0.0f), duration);
+	case LoopMode::PingPong:
+	{
+		float t = fmod(elapsed, duration * 2);
+		if (t < 0) {
+			t += duration * 2;
+		}
+		return t > duration ? duration * 2 - t : t;
+	}
+	default:
+	{
+		float t = fmod(elapsed, duration);
+		return t < 0 ? t + duration : t;
 	}
+	}
+}
 
-	return m_bone_trans;
+const SkeletalAnim::ModelExtend* ModelInstance::GetAnim(int idx) const
+{
+	if (!m_model->ext || m_model->ext->Type() != EXT_SKELETAL) {
+		return nullptr;
+	}
+
+	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
+	auto& anims = sk_anim->GetAnims();
+	if (idx < 0 || idx >= static_cast<int>(anims.size())) {
+		return nullptr;
+	}
+
+	return anims[idx].get();
 }
 
-void ModelInstance::CalcGlobalTrans()
+void ModelInstance::CalcGlobalTrans(int root)
 {
 	if (!m_model->ext || m_model->ext->Type() != EXT_SKELETAL) {
 		return;
 	}
 
+	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
+	sk_anim->CalcGlobalTrans(m_local_pose, m_global_trans, root);
+}
+
+void ModelInstance::InitNodeBounds()
+{
 	auto sk_anim = static_cast<SkeletalAnim*>(m_model->ext.get());
 	auto& nodes = sk_anim->GetNodes();
-	size_t sz = m_local_trans.size();
-	if (m_global_trans.size() != sz) {
-		m_global_trans.resize(sz);
+
+	// every bone's offset_trans maps into its node's bind space, so bones of
+	// different meshes on one node share a bound
+	std::vector<sm::cube> bounds(nodes.size());
+	std::vector<bool> posed(m_model->meshes.size(), false);
+	for (size_t i = 0, n = m_model->meshes.size(); i < n; ++i)
+	{
+		auto& geo = m_model->meshes[i]->geometry;
+		if (geo.bones.empty()) {
+			continue;
+		}
+
+		// loaders that fill no bone bounds leave the mesh at its bind pose aabb
+		bool all_bound = true, any_bound = false;
+		for (auto& bone : geo.bones)
+		{
+			if (bone.node < 0) {
+				all_bound = false;
+			} else if (!is_empty(bone.bound)) {
+				bounds[bone.node].Combine(bone.bound);
+				any_bound = true;
+			}
+		}
+		posed[i] = all_bound && any_bound;
 	}
-	for (size_t i = 0; i < sz; ++i)
+
+	for (int i = 0, n = nodes.size(); i < n; ++i)
 	{
-		auto g_trans = m_local_trans[i];
-		int parent = nodes[i]->parent;
-		while (parent != -1) {
-			g_trans = m_local_trans[parent] * g_trans;
-			parent = nodes[parent]->parent;
+		for (auto mesh : nodes[i]->meshes)
+		{
+			if (mesh < 0 || mesh >= static_cast<int>(m_model->meshes.size()) || posed[mesh]) {
+				continue;
+			}
+
+			auto& aabb = m_model->meshes[mesh]->geometry.aabb;
+			if (is_empty(aabb)) {
+				continue;
+			}
+			if (m_model->meshes[mesh]->geometry.bones.empty()) {
+				bounds[i].Combine(aabb);
+			} else {
+				// skinned by unresolved or unbounded bones, keep it conservative
+				combine_trans_aabb(m_static_bound, aabb, m_global_trans[i]);
+			}
+		}
+	}
+
+	for (int i = 0, n = bounds.size(); i < n; ++i) {
+		if (!is_empty(bounds[i])) {
+			m_node_bounds.push_back({ i, bounds[i] });
 		}
-		m_global_trans[i] = g_trans;
 	}
 }
 
-}
\ No newline at end of file
+}
@@ -1,5 +1,9 @@
 #include "model/MorphTargetAnim.h"
 
+#include <algorithm>
+
+#include <math.h>
+
 namespace model
 {
 
@@ -12,10 +16,19 @@ MorphTargetAnim::MorphTargetAnim(int fps, int num_frames, int num_vertices)
 
 std::unique_ptr<ModelExtend> MorphTargetAnim::Clone() const
 {
-    auto ret = std::make_unique<MorphTargetAnim>(m_fps, m_num_frames, m_num_vertices);
-    ret->SetFrame(m_frame);
-    ret->SetBlend(m_blend);
-    return ret;
+    return std::make_unique<MorphTargetAnim>(m_fps, m_num_frames, m_num_vertices);
+}
+
+MorphTargetAnim::State MorphTargetAnim::CalcState(float time) const
+{
+	State st;
+	if (m_num_frames > 1)
+	{
+		float f_frame = time * m_fps;
+		st.frame = std::min(static_cast<int>(f_frame), m_num_frames - 1);
+		st.blend = f_frame - floorf(f_frame);
+	}
+	return st;
 }
 
 }
\ No newline at end of file
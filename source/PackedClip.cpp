@@ -0,0 +1,328 @@
+#include "model/PackedClip.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MODEL_PACKED_CLIP_SSE
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+
+#include <assert.h>
+#include <math.h>
+
+namespace
+{
+
+// below this |cos(angle)| between two keys nlerp drifts noticeably, use slerp
+const float NLERP_MIN_DOT = 0.95f;
+
+// last key with time <= t (or key 0), O(1) when t is at or just after
+// the cursor key, O(log n) otherwise
+uint32_t find_key(const float* times, uint32_t count, float t, uint32_t cursor)
+{
+	const uint32_t last = count - 1;
+	if (cursor < count && t >= times[cursor])
+	{
+		if (cursor == last || t < times[cursor + 1]) {
+			return cursor;
+		}
+		if (cursor + 1 == last || t < times[cursor + 2]) {
+			return cursor + 1;
+		}
+	}
+
+	auto itr = std::upper_bound(times + 1, times + count, t);
+	return static_cast<uint32_t>(itr - times) - 1;
+}
+
+}
+
+namespace model
+{
+
+PackedClip::PackedClip(const SkeletalAnim::ModelExtend& anim)
+	: m_duration(anim.duration)
+	, m_num_channels(static_cast<int>(anim.channels.size()))
+{
+	const size_t n_padded = (anim.channels.size() + 3) & ~size_t(3);
+	m_pos_tracks.resize(n_padded);
+	m_rot_tracks.resize(n_padded);
+	m_scale_tracks.resize(n_padded);
+
+	size_t n_pos = 1, n_rot = 1, n_scale = 1;
+	for (auto& c : anim.channels) {
+		n_pos   += c->position_keys.size();
+		n_rot   += c->rotation_keys.size();
+		n_scale += c->scaling_keys.size();
+	}
+	m_pos_keys.time.reserve(n_pos);
+	m_rot_keys.time.reserve(n_rot);
+	m_scale_keys.time.reserve(n_scale);
+
+	m_pos_keys.Push(0, sm::vec3(0, 0, 0));
+	m_rot_keys.Push(0, sm::Quaternion());
+	m_scale_keys.Push(0, sm::vec3(1, 1, 1));
+
+	for (size_t i = 0, n = anim.channels.size(); i < n; ++i)
+	{
+		auto& c = anim.channels[i];
+
+		if (!c->position_keys.empty())
+		{
+			m_pos_tracks[i].begin = static_cast<uint32_t>(m_pos_keys.time.size());
+			m_pos_tracks[i].count = static_cast<uint32_t>(c->position_keys.size());
+			for (auto& key : c->position_keys) {
+				m_pos_keys.Push(key.first, key.second);
+			}
+		}
+
+		if (!c->rotation_keys.empty())
+		{
+			m_rot_tracks[i].begin = static_cast<uint32_t>(m_rot_keys.time.size());
+			m_rot_tracks[i].count = static_cast<uint32_t>(c->rotation_keys.size());
+			for (auto& key : c->rotation_keys) {
+				m_rot_keys.Push(key.first, key.second);
+			}
+		}
+
+		if (!c->scaling_keys.empty())
+		{
+			m_scale_tracks[i].begin = static_cast<uint32_t>(m_scale_keys.time.size());
+			m_scale_tracks[i].count = static_cast<uint32_t>(c->scaling_keys.size());
+			for (auto& key : c->scaling_keys) {
+				m_scale_keys.Push(key.first, key.second);
+			}
+		}
+	}
+}
+
+void PackedClip::Sample(float time, Cursor* cursors, sm::vec3* trans,
+	                    sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask) const
+{
+	Lanes lanes;
+	for (int i = 0; i < m_num_channels; i += 4)
+	{
+		const int num = std::min(4, m_num_channels - i);
+
+		// whole groups only
+		if (channel_mask && std::none_of(channel_mask + i, channel_mask + i + num, [](uint8_t m) { return m != 0; })) {
+			continue;
+		}
+
+		FindKeys(&m_pos_tracks[i], m_pos_keys.time, time, i, num, &Cursor::pos, cursors, lanes);
+		LerpVec3(m_pos_keys, lanes, num, trans + i);
+
+		FindKeys(&m_rot_tracks[i], m_rot_keys.time, time, i, num, &Cursor::rot, cursors, lanes);
+		NlerpQuat(lanes, num, rot + i);
+
+		FindKeys(&m_scale_tracks[i], m_scale_keys.time, time, i, num, &Cursor::scale, cursors, lanes);
+		LerpVec3(m_scale_keys, lanes, num, scale + i);
+	}
+}
+
+int PackedClip::CountSkipped(const uint8_t* channel_mask) const
+{
+	if (!channel_mask) {
+		return 0;
+	}
+
+	// whole groups only, as Sample()
+	int n_skipped = 0;
+	for (int i = 0; i < m_num_channels; i += 4)
+	{
+		const int num = std::min(4, m_num_channels - i);
+		if (std::none_of(channel_mask + i, channel_mask + i + num, [](uint8_t m) { return m != 0; })) {
+			n_skipped += num;
+		}
+	}
+	return n_skipped;
+}
+
+size_t PackedClip::GetMemSize() const
+{
+	size_t sz = sizeof(PackedClip);
+	sz += (m_pos_tracks.capacity() + m_rot_tracks.capacity() + m_scale_tracks.capacity()) * sizeof(Track);
+	for (auto keys : { &m_pos_keys, &m_scale_keys }) {
+		sz += (keys->time.capacity() + keys->x.capacity() + keys->y.capacity() + keys->z.capacity()) * sizeof(float);
+	}
+	sz += (m_rot_keys.time.capacity() + m_rot_keys.x.capacity() + m_rot_keys.y.capacity()
+		+ m_rot_keys.z.capacity() + m_rot_keys.w.capacity()) * sizeof(float);
+	return sz;
+}
+
+void PackedClip::Vec3Keys::Push(float t, const sm::vec3& v)
+{
+	time.push_back(t);
+	x.push_back(v.x);
+	y.push_back(v.y);
+	z.push_back(v.z);
+}
+
+void PackedClip::QuatKeys::Push(float t, const sm::Quaternion& q)
+{
+	time.push_back(t);
+	x.push_back(q.x);
+	y.push_back(q.y);
+	z.push_back(q.z);
+	w.push_back(q.w);
+}
+
+void PackedClip::FindKeys(const Track* tracks, const std::vector<float>& times, float time,
+	                      int begin, int num, uint32_t Cursor::* field, Cursor* cursors, Lanes& lanes) const
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		auto& track = tracks[i];
+		if (i >= num || track.count == 0)
+		{
+			lanes.k0[i] = lanes.k1[i] = 0;
+			lanes.factor[i] = 0;
+			continue;
+		}
+
+		auto t = &times[track.begin];
+
+		uint32_t& cursor = cursors[begin + i].*field;
+		const uint32_t frame = find_key(t, track.count, time, cursor);
+		cursor = frame;
+
+		uint32_t next_frame = (frame + 1) % track.count;
+		float diff_time = t[next_frame] - t[frame];
+		if (diff_time < 0) {
+			diff_time += m_duration;
+		}
+
+		lanes.k0[i] = track.begin + frame;
+		lanes.k1[i] = track.begin + next_frame;
+		lanes.factor[i] = diff_time > 0 ? (time - t[frame]) / diff_time : 0;
+	}
+}
+
+void PackedClip::LerpVec3(const Vec3Keys& keys, const Lanes& lanes, int num, sm::vec3* dst) const
+{
+	auto& k0 = lanes.k0;
+	auto& k1 = lanes.k1;
+
+#ifdef MODEL_PACKED_CLIP_SSE
+	const __m128 f = _mm_loadu_ps(lanes.factor);
+
+	const __m128 ax = _mm_set_ps(keys.x[k0[3]], keys.x[k0[2]], keys.x[k0[1]], keys.x[k0[0]]);
+	const __m128 ay = _mm_set_ps(keys.y[k0[3]], keys.y[k0[2]], keys.y[k0[1]], keys.y[k0[0]]);
+	const __m128 az = _mm_set_ps(keys.z[k0[3]], keys.z[k0[2]], keys.z[k0[1]], keys.z[k0[0]]);
+	const __m128 bx = _mm_set_ps(keys.x[k1[3]], keys.x[k1[2]], keys.x[k1[1]], keys.x[k1[0]]);
+	const __m128 by = _mm_set_ps(keys.y[k1[3]], keys.y[k1[2]], keys.y[k1[1]], keys.y[k1[0]]);
+	const __m128 bz = _mm_set_ps(keys.z[k1[3]], keys.z[k1[2]], keys.z[k1[1]], keys.z[k1[0]]);
+
+	float x[4], y[4], z[4];
+	_mm_storeu_ps(x, _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), f)));
+	_mm_storeu_ps(y, _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), f)));
+	_mm_storeu_ps(z, _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), f)));
+
+	for (int i = 0; i < num; ++i) {
+		dst[i].x = x[i];
+		dst[i].y = y[i];
+		dst[i].z = z[i];
+	}
+#else
+	for (int i = 0; i < num; ++i)
+	{
+		const float f = lanes.factor[i];
+		dst[i].x = keys.x[k0[i]] + (keys.x[k1[i]] - keys.x[k0[i]]) * f;
+		dst[i].y = keys.y[k0[i]] + (keys.y[k1[i]] - keys.y[k0[i]]) * f;
+		dst[i].z = keys.z[k0[i]] + (keys.z[k1[i]] - keys.z[k0[i]]) * f;
+	}
+#endif // MODEL_PACKED_CLIP_SSE
+}
+
+void PackedClip::NlerpQuat(const Lanes& lanes, int num, sm::Quaternion* dst) const
+{
+	auto& keys = m_rot_keys;
+	auto& k0 = lanes.k0;
+	auto& k1 = lanes.k1;
+
+	float dot[4];
+
+#ifdef MODEL_PACKED_CLIP_SSE
+	const __m128 f = _mm_loadu_ps(lanes.factor);
+
+	const __m128 ax = _mm_set_ps(keys.x[k0[3]], keys.x[k0[2]], keys.x[k0[1]], keys.x[k0[0]]);
+	const __m128 ay = _mm_set_ps(keys.y[k0[3]], keys.y[k0[2]], keys.y[k0[1]], keys.y[k0[0]]);
+	const __m128 az = _mm_set_ps(keys.z[k0[3]], keys.z[k0[2]], keys.z[k0[1]], keys.z[k0[0]]);
+	const __m128 aw = _mm_set_ps(keys.w[k0[3]], keys.w[k0[2]], keys.w[k0[1]], keys.w[k0[0]]);
+	__m128 bx = _mm_set_ps(keys.x[k1[3]], keys.x[k1[2]], keys.x[k1[1]], keys.x[k1[0]]);
+	__m128 by = _mm_set_ps(keys.y[k1[3]], keys.y[k1[2]], keys.y[k1[1]], keys.y[k1[0]]);
+	__m128 bz = _mm_set_ps(keys.z[k1[3]], keys.z[k1[2]], keys.z[k1[1]], keys.z[k1[0]]);
+	__m128 bw = _mm_set_ps(keys.w[k1[3]], keys.w[k1[2]], keys.w[k1[1]], keys.w[k1[0]]);
+
+	// shortest path: flip b where dot(a, b) < 0
+	__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+		                  _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+	const __m128 sign = _mm_and_ps(d, _mm_set1_ps(-0.0f));
+	bx = _mm_xor_ps(bx, sign);
+	by = _mm_xor_ps(by, sign);
+	bz = _mm_xor_ps(bz, sign);
+	bw = _mm_xor_ps(bw, sign);
+	_mm_storeu_ps(dot, _mm_xor_ps(d, sign));
+
+	__m128 x = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), f));
+	__m128 y = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), f));
+	__m128 z = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), f));
+	__m128 w = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), f));
+
+	const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+		                           _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+	const __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+
+	float qx[4], qy[4], qz[4], qw[4];
+	_mm_storeu_ps(qx, _mm_mul_ps(x, inv_len));
+	_mm_storeu_ps(qy, _mm_mul_ps(y, inv_len));
+	_mm_storeu_ps(qz, _mm_mul_ps(z, inv_len));
+	_mm_storeu_ps(qw, _mm_mul_ps(w, inv_len));
+
+	for (int i = 0; i < num; ++i) {
+		dst[i].x = qx[i];
+		dst[i].y = qy[i];
+		dst[i].z = qz[i];
+		dst[i].w = qw[i];
+	}
+#else
+	for (int i = 0; i < num; ++i)
+	{
+		const float f = lanes.factor[i];
+
+		float ax = keys.x[k0[i]], ay = keys.y[k0[i]], az = keys.z[k0[i]], aw = keys.w[k0[i]];
+		float bx = keys.x[k1[i]], by = keys.y[k1[i]], bz = keys.z[k1[i]], bw = keys.w[k1[i]];
+
+		float d = ax * bx + ay * by + az * bz + aw * bw;
+		if (d < 0) {
+			bx = -bx; by = -by; bz = -bz; bw = -bw;
+			d = -d;
+		}
+		dot[i] = d;
+
+		float x = ax + (bx - ax) * f;
+		float y = ay + (by - ay) * f;
+		float z = az + (bz - az) * f;
+		float w = aw + (bw - aw) * f;
+		float inv_len = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+		dst[i].x = x * inv_len;
+		dst[i].y = y * inv_len;
+		dst[i].z = z * inv_len;
+		dst[i].w = w * inv_len;
+	}
+#endif // MODEL_PACKED_CLIP_SSE
+
+	// keys far apart, fall back to slerp
+	for (int i = 0; i < num; ++i)
+	{
+		if (dot[i] < NLERP_MIN_DOT && k0[i] != k1[i])
+		{
+			sm::Quaternion a, b;
+			a.x = keys.x[k0[i]]; a.y = keys.y[k0[i]]; a.z = keys.z[k0[i]]; a.w = keys.w[k0[i]];
+			b.x = keys.x[k1[i]]; b.y = keys.y[k1[i]]; b.z = keys.z[k1[i]]; b.w = keys.w[k1[i]];
+			dst[i].Slerp(a, b, lanes.factor[i]);
+		}
+	}
+}
+
+}
@@ -0,0 +1,27 @@
+#include "model/PoseBuffer.h"
+
+namespace model
+{
+
+PoseBuffer::PoseBuffer()
+	: m_middle(1)
+{
+}
+
+void PoseBuffer::Publish()
+{
+	m_slots[m_back].version = ++m_version;
+	m_back = m_middle.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel) & ~FRESH_BIT;
+}
+
+const PoseSnapshot* PoseBuffer::Acquire()
+{
+	if (m_middle.load(std::memory_order_relaxed) & FRESH_BIT)
+	{
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~FRESH_BIT;
+		m_has_front = true;
+	}
+	return m_has_front ? &m_slots[m_front] : nullptr;
+}
+
+}
@@ -0,0 +1,255 @@
+#include "model/PoseCache.h"
+#include "model/ClipSampler.h"
+#include "model/UniformClip.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+namespace
+{
+
+const int LOCAL_STRIDE = model::UniformClip::STRIDE;
+const int MODEL_STRIDE = 12;
+
+const int QRANGE_STRIDE = 12;
+
+int16_t quantize_unit(float v)
+{
+	v = std::min(1.0f, std::max(-1.0f, v));
+	return static_cast<int16_t>(roundf(v * 32767.0f));
+}
+
+float dequantize_unit(int16_t v)
+{
+	return v / 32767.0f;
+}
+
+int16_t quantize_range(float v, float min, float ext)
+{
+	if (ext <= 0) {
+		return -32768;
+	}
+	float f = std::min(1.0f, std::max(0.0f, (v - min) / ext));
+	return static_cast<int16_t>(roundf(f * 65535.0f) - 32768.0f);
+}
+
+float dequantize_range(int16_t v, float min, float ext)
+{
+	return min + (static_cast<float>(v) + 32768.0f) / 65535.0f * ext;
+}
+
+}
+
+namespace model
+{
+
+PoseCache::PoseCache(const SkeletalAnim& sk_anim, const SkeletalAnim::ModelExtend& anim,
+	                 Space space, bool quantize)
+	: m_space(space)
+	, m_duration(anim.duration)
+{
+	auto& sampler = *anim.sampler;
+
+	m_num_frames = UniformClip::CalcNumFrames(anim);
+
+	const int n_channels = sampler.GetNumChannels();
+	if (space == Space::Local)
+	{
+		m_num_items = n_channels;
+		UniformClip::BakeFrames(sampler, m_duration, m_num_frames, m_data);
+		if (quantize) {
+			Quantize();
+		}
+		return;
+	}
+
+	std::vector<ClipSampler::Cursor> cursors(n_channels);
+	std::vector<sm::vec3>       trans(n_channels);
+	std::vector<sm::Quaternion> rot(n_channels);
+	std::vector<sm::vec3>       scale(n_channels);
+
+	auto& nodes = sk_anim.GetNodes();
+	std::vector<sm::mat4> local_trans, global_trans;
+	local_trans.reserve(nodes.size());
+	for (auto& node : nodes) {
+		local_trans.push_back(node->local_trans);
+	}
+
+	m_num_items = static_cast<int>(nodes.size());
+	m_data.resize(static_cast<size_t>(m_num_frames) * m_num_items * MODEL_STRIDE);
+
+	for (int f = 0; f < m_num_frames; ++f)
+	{
+		float time = m_num_frames > 1 ? m_duration * f / (m_num_frames - 1) : 0;
+		sampler.Sample(time, cursors.data(), trans.data(), rot.data(), scale.data());
+
+		for (int i = 0, n = nodes.size(); i < n; ++i)
+		{
+			int c = anim.node_to_channel[i];
+			if (c >= 0) {
+				local_trans[i] = SkeletalAnim::ComposeTrans(trans[c], rot[c], scale[c]);
+			}
+		}
+		sk_anim.CalcGlobalTrans(local_trans, global_trans);
+
+		float* dst = &m_data[static_cast<size_t>(f) * m_num_items * MODEL_STRIDE];
+		for (auto& m : global_trans)
+		{
+			for (int col = 0; col < 4; ++col) {
+				for (int row = 0; row < 3; ++row) {
+					*dst++ = m.c[col][row];
+				}
+			}
+		}
+	}
+}
+
+void PoseCache::Sample(float time, sm::vec3* trans, sm::Quaternion* rot, sm::vec3* scale) const
+{
+	assert(m_space == Space::Local);
+
+	int frame;
+	float f;
+	CalcFrame(time, frame, f);
+
+	const int next = std::min(frame + 1, m_num_frames - 1);
+	const size_t off0 = static_cast<size_t>(frame) * m_num_items * LOCAL_STRIDE;
+	const size_t off1 = static_cast<size_t>(next) * m_num_items * LOCAL_STRIDE;
+
+	float a[LOCAL_STRIDE], b[LOCAL_STRIDE], v[LOCAL_STRIDE];
+	for (int i = 0; i < m_num_items; ++i)
+	{
+		const size_t item = static_cast<size_t>(i) * LOCAL_STRIDE;
+		if (m_qdata.empty())
+		{
+			for (int j = 0; j < LOCAL_STRIDE; ++j) {
+				v[j] = m_data[off0 + item + j] + (m_data[off1 + item + j] - m_data[off0 + item + j]) * f;
+			}
+		}
+		else
+		{
+			auto qa = &m_qdata[off0 + item];
+			auto qb = &m_qdata[off1 + item];
+			auto range = &m_qrange[static_cast<size_t>(i) * QRANGE_STRIDE];
+			for (int j = 0; j < 3; ++j)
+			{
+				a[j] = dequantize_range(qa[j], range[j], range[3 + j]);
+				b[j] = dequantize_range(qb[j], range[j], range[3 + j]);
+				a[7 + j] = dequantize_range(qa[7 + j], range[6 + j], range[9 + j]);
+				b[7 + j] = dequantize_range(qb[7 + j], range[6 + j], range[9 + j]);
+			}
+			for (int j = 3; j < 7; ++j) {
+				a[j] = dequantize_unit(qa[j]);
+				b[j] = dequantize_unit(qb[j]);
+			}
+			for (int j = 0; j < LOCAL_STRIDE; ++j) {
+				v[j] = a[j] + (b[j] - a[j]) * f;
+			}
+		}
+
+		trans[i].x = v[0]; trans[i].y = v[1]; trans[i].z = v[2];
+		const float len2 = v[3] * v[3] + v[4] * v[4] + v[5] * v[5] + v[6] * v[6];
+		const float inv_len = len2 > 0 ? 1.0f / sqrtf(len2) : 0;
+		rot[i].x = v[3] * inv_len; rot[i].y = v[4] * inv_len;
+		rot[i].z = v[5] * inv_len; rot[i].w = v[6] * inv_len;
+		scale[i].x = v[7]; scale[i].y = v[8]; scale[i].z = v[9];
+	}
+}
+
+void PoseCache::Sample(float time, sm::mat4* global_trans) const
+{
+	assert(m_space == Space::Model);
+
+	int frame;
+	float f;
+	CalcFrame(time, frame, f);
+
+	const int next = std::min(frame + 1, m_num_frames - 1);
+	const float* a = &m_data[static_cast<size_t>(frame) * m_num_items * MODEL_STRIDE];
+	const float* b = &m_data[static_cast<size_t>(next) * m_num_items * MODEL_STRIDE];
+	for (int i = 0; i < m_num_items; ++i)
+	{
+		auto& m = global_trans[i];
+		for (int col = 0; col < 4; ++col) {
+			for (int row = 0; row < 3; ++row, ++a, ++b) {
+				m.c[col][row] = *a + (*b - *a) * f;
+			}
+		}
+		m.c[0][3] = 0; m.c[1][3] = 0; m.c[2][3] = 0; m.c[3][3] = 1;
+	}
+}
+
+size_t PoseCache::GetMemSize() const
+{
+	return sizeof(PoseCache)
+		+ m_data.capacity() * sizeof(float)
+		+ m_qdata.capacity() * sizeof(int16_t)
+		+ m_qrange.capacity() * sizeof(float);
+}
+
+void PoseCache::CalcFrame(float time, int& frame, float& factor) const
+{
+	frame  = 0;
+	factor = 0;
+	if (m_num_frames < 2 || m_duration <= 0) {
+		return;
+	}
+
+	float f = std::min(1.0f, std::max(0.0f, time / m_duration)) * (m_num_frames - 1);
+	frame = std::min(static_cast<int>(f), m_num_frames - 2);
+	factor = f - frame;
+}
+
+void PoseCache::Quantize()
+{
+	m_qrange.assign(static_cast<size_t>(m_num_items) * QRANGE_STRIDE, 0);
+	for (int i = 0; i < m_num_items; ++i)
+	{
+		float* range = &m_qrange[static_cast<size_t>(i) * QRANGE_STRIDE];
+		for (int j = 0; j < 3; ++j)
+		{
+			float t_min = FLT_MAX, t_max = -FLT_MAX;
+			float s_min = FLT_MAX, s_max = -FLT_MAX;
+			for (int f = 0; f < m_num_frames; ++f)
+			{
+				const float* src = &m_data[(static_cast<size_t>(f) * m_num_items + i) * LOCAL_STRIDE];
+				t_min = std::min(t_min, src[j]);
+				t_max = std::max(t_max, src[j]);
+				s_min = std::min(s_min, src[7 + j]);
+				s_max = std::max(s_max, src[7 + j]);
+			}
+			range[j]     = t_min;
+			range[3 + j] = t_max - t_min;
+			range[6 + j] = s_min;
+			range[9 + j] = s_max - s_min;
+		}
+	}
+
+	m_qdata.resize(m_data.size());
+	for (int f = 0; f < m_num_frames; ++f)
+	{
+		for (int i = 0; i < m_num_items; ++i)
+		{
+			const size_t off = (static_cast<size_t>(f) * m_num_items + i) * LOCAL_STRIDE;
+			const float* src = &m_data[off];
+			int16_t* dst = &m_qdata[off];
+			const float* range = &m_qrange[static_cast<size_t>(i) * QRANGE_STRIDE];
+			for (int j = 0; j < 3; ++j)
+			{
+				dst[j]     = quantize_range(src[j], range[j], range[3 + j]);
+				dst[7 + j] = quantize_range(src[7 + j], range[6 + j], range[9 + j]);
+			}
+			for (int j = 3; j < 7; ++j) {
+				dst[j] = quantize_unit(src[j]);
+			}
+		}
+	}
+
+	m_data.clear();
+	m_data.shrink_to_fit();
+}
+
+}
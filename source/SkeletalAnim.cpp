@@ -1,62 +1,723 @@
 #include "model/SkeletalAnim.h"
+#include "model/PackedClip.h"
+#include "model/CompressedClip.h"
+#include "model/UniformClip.h"
+#include "model/PoseCache.h"
 
-namespace model
+#include <algorithm>
+
+#include <assert.h>
+
+namespace
 {
 
-std::unique_ptr<model::ModelExtend> SkeletalAnim::Clone() const
+const float CONST_VEC_EPS  = 1e-5f;
+const float CONST_QUAT_EPS = 1e-6f;
+
+bool is_equal(const sm::vec3& a, const sm::vec3& b)
 {
-    auto ret = std::make_unique<SkeletalAnim>();
+	return fabs(a.x - b.x) <= CONST_VEC_EPS
+		&& fabs(a.y - b.y) <= CONST_VEC_EPS
+		&& fabs(a.z - b.z) <= CONST_VEC_EPS;
+}
 
-    ret->m_nodes.reserve(m_nodes.size());
-    for (auto& n : m_nodes) {
-        ret->m_nodes.push_back(std::make_unique<Node>(*n));
-    }
+bool is_equal(const sm::Quaternion& a, const sm::Quaternion& b)
+{
+	// q and -q are the same rotation
+	return fabs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w) >= 1.0f - CONST_QUAT_EPS;
+}
 
-    ret->m_tpose_world_trans = m_tpose_world_trans;
+// shrink to the first key if all keys are the same, return the removed count
+template<typename T>
+int collapse_constant(std::vector<std::pair<float, T>>& keys)
+{
+	for (size_t i = 1, n = keys.size(); i < n; ++i) {
+		if (!is_equal(keys[i].second, keys[0].second)) {
+			return 0;
+		}
+	}
 
-    ret->m_anims.reserve(m_anims.size());
-    for (auto& anim : m_anims) {
-        ret->m_anims.push_back(std::make_unique<SkeletalAnim::ModelExtend>(*anim));
-    }
+	const int removed = keys.empty() ? 0 : static_cast<int>(keys.size()) - 1;
+	keys.resize(std::min(keys.size(), size_t(1)));
+	return removed;
+}
 
+// Greedy: extend each segment from the last kept key while lerping across it
+// stays within tolerance of every key it skips. First and last keys stay.
+template<typename T, typename Lerp, typename Error>
+int reduce_keys(std::vector<std::pair<float, T>>& keys, float tolerance, Lerp lerp, Error error)
+{
+	if (keys.size() < 3) {
+		return 0;
+	}
+
+	std::vector<std::pair<float, T>> dst;
+	dst.push_back(keys[0]);
+
+	size_t anchor = 0;
+	for (size_t i = 2, n = keys.size(); i < n; ++i)
+	{
+		auto& a = keys[anchor];
+		auto& b = keys[i];
+		const float span = b.first - a.first;
+
+		bool fit = true;
+		for (size_t j = anchor + 1; j < i && fit; ++j)
+		{
+			const float t = span > 0 ? (keys[j].first - a.first) / span : 0;
+			fit = error(lerp(a.second, b.second, t), keys[j].second) <= tolerance;
+		}
+		if (!fit)
+		{
+			anchor = i - 1;
+			dst.push_back(keys[anchor]);
+		}
+	}
+	dst.push_back(keys.back());
+
+	const int removed = static_cast<int>(keys.size() - dst.size());
+	keys.swap(dst);
+	return removed;
+}
+
+// quantized by CompressAnims(), only the sampler has the keys
+bool is_quantized(const model::SkeletalAnim::ModelExtend& anim)
+{
+	if (std::dynamic_pointer_cast<const model::CompressedClip>(anim.sampler)) {
+		return true;
+	}
+	// resampled since, the channels are still name only
+	for (auto& c : anim.channels) {
+		if (!c->position_keys.empty() || !c->rotation_keys.empty() || !c->scaling_keys.empty()) {
+			return false;
+		}
+	}
+	return !anim.channels.empty();
+}
+
+}
+
+namespace model
+{
+
+const int SkeletalAnim::MAX_LOD_TIER;
+
+std::unique_ptr<model::ModelExtend> SkeletalAnim::Clone() const
+{
+    auto ret = std::make_unique<SkeletalAnim>();
+    ret->m_skeleton = m_skeleton;
+    ret->m_anims    = m_anims;
     return ret;
 }
 
 void SkeletalAnim::SetAnims(std::vector<std::unique_ptr<ModelExtend>>& anims)
 {
-	m_anims = std::move(anims);
+	AnimList list;
+	list.reserve(anims.size());
+	for (auto& anim : anims)
+	{
+		SortChannelsByLod(*anim);
+		anim->sampler = std::make_shared<PackedClip>(*anim);
+		list.push_back(std::move(anim));
+	}
+	anims.clear();
+
+	m_anims = BindChannels(list);
 }
 
 void SkeletalAnim::SetNodes(std::vector<std::unique_ptr<Node>>& nodes)
 {
-	m_nodes = std::move(nodes);
-	InitTPoseTrans();
+	auto sk = std::make_shared<Skeleton>();
+	sk->nodes = std::move(nodes);
+
+	sk->name2node.reserve(sk->nodes.size());
+	for (int i = 0, n = sk->nodes.size(); i < n; ++i) {
+		// keep the first one, same as the linear search did
+		sk->name2node.insert({ sk->nodes[i]->name, i });
+	}
+
+	auto& bind = sk->bind_pose;
+	bind.Resize(sk->nodes.size());
+	for (size_t i = 0, n = sk->nodes.size(); i < n; ++i) {
+		DecomposeTrans(sk->nodes[i]->local_trans, bind.trans[i], bind.rot[i], bind.scale[i]);
+	}
+
+	InitEvalOrder(*sk);
+
+	m_skeleton = sk;
+	InitTPoseTrans(*sk);
+
+	m_anims = BindChannels(*m_anims);
+}
+
+int SkeletalAnim::QueryNodeByName(const std::string& name) const
+{
+	auto& name2node = m_skeleton->name2node;
+	auto itr = name2node.find(name);
+	return itr == name2node.end() ? -1 : itr->second;
+}
+
+void SkeletalAnim::CalcGlobalTrans(const std::vector<sm::mat4>& local_trans,
+	                               std::vector<sm::mat4>& global_trans, int root) const
+{
+	auto& sk = *m_skeleton;
+	assert(local_trans.size() == sk.nodes.size());
+	if (global_trans.size() != local_trans.size()) {
+		global_trans.resize(local_trans.size());
+		root = -1;
+	}
+
+	int begin = 0, end = static_cast<int>(sk.eval_order.size());
+	if (root >= 0) {
+		begin = sk.subtree_range[root].first;
+		end   = sk.subtree_range[root].second;
+	}
+
+	for (int i = begin; i < end; ++i)
+	{
+		const int node   = sk.eval_order[i];
+		const int parent = sk.eval_parent[i];
+		if (parent < 0) {
+			global_trans[node] = local_trans[node];
+		} else {
+			global_trans[node] = global_trans[parent] * local_trans[node]; // mat mul
+		}
+	}
+}
+
+SkeletalAnim::OptimizeStats SkeletalAnim::OptimizeAnims(const std::vector<int>& keep_nodes)
+{
+	OptimizeStats st;
+
+	auto& nodes = m_skeleton->nodes;
+	auto& bind  = m_skeleton->bind_pose;
+	const int n_nodes = static_cast<int>(nodes.size());
+
+	// kept nodes and their ancestors
+	std::vector<bool> used(n_nodes, false);
+	for (auto node : keep_nodes) {
+		for (int i = node; i >= 0 && i < n_nodes && !used[i]; i = nodes[i]->parent) {
+			used[i] = true;
+		}
+	}
+
+	// copies with unused channels removed and constant tracks collapsed
+	std::vector<std::unique_ptr<ModelExtend>> anims;
+	anims.reserve(m_anims->size());
+	std::vector<std::vector<int>> channel_nodes;
+	for (auto& src : *m_anims)
+	{
+		st.num_channels += static_cast<int>(src->channels.size());
+
+		// needs the float keys, kept as it is
+		if (is_quantized(*src))
+		{
+			anims.push_back(std::make_unique<ModelExtend>(*src));
+			continue;
+		}
+
+		channel_nodes.assign(src->channels.size(), std::vector<int>());
+		for (int i = 0; i < n_nodes; ++i) {
+			if (src->node_to_channel[i] >= 0) {
+				channel_nodes[src->node_to_channel[i]].push_back(i);
+			}
+		}
+
+		auto dst = std::make_unique<ModelExtend>();
+		dst->name             = src->name;
+		dst->duration         = src->duration;
+		dst->ticks_per_second = src->ticks_per_second;
+		for (int i = 0, n = src->channels.size(); i < n; ++i)
+		{
+			auto& c_nodes = channel_nodes[i];
+			if (std::none_of(c_nodes.begin(), c_nodes.end(), [&](int node) { return used[node]; }))
+			{
+				++st.unused;
+				continue;
+			}
+
+			auto c = std::make_shared<NodeAnim>(*src->channels[i]);
+			st.keys_removed += collapse_constant(c->position_keys);
+			st.keys_removed += collapse_constant(c->rotation_keys);
+			st.keys_removed += collapse_constant(c->scaling_keys);
+			dst->channels.push_back(c);
+		}
+		anims.push_back(std::move(dst));
+	}
+
+	// nodes that stay at the bind pose in every clip driving them, same
+	// defaults as PackedClip for empty tracks
+	std::vector<bool> at_bind(n_nodes, true);
+	std::unordered_map<std::string, int> name2channel;
+	for (auto& anim : anims)
+	{
+		name2channel.clear();
+		for (int i = 0, n = anim->channels.size(); i < n; ++i) {
+			name2channel[anim->channels[i]->name] = i;
+		}
+
+		const bool quantized = is_quantized(*anim);
+		for (int i = 0; i < n_nodes; ++i)
+		{
+			auto itr = name2channel.find(nodes[i]->name);
+			if (itr == name2channel.end() || !at_bind[i]) {
+				continue;
+			}
+			if (quantized)
+			{
+				at_bind[i] = false;
+				continue;
+			}
+
+			auto& c = *anim->channels[itr->second];
+			if (c.position_keys.size() > 1 || c.rotation_keys.size() > 1 || c.scaling_keys.size() > 1) {
+				at_bind[i] = false;
+				continue;
+			}
+
+			auto t = c.position_keys.empty() ? sm::vec3(0, 0, 0) : c.position_keys[0].second;
+			auto r = c.rotation_keys.empty() ? sm::Quaternion() : c.rotation_keys[0].second;
+			auto s = c.scaling_keys.empty() ? sm::vec3(1, 1, 1) : c.scaling_keys[0].second;
+			at_bind[i] = is_equal(t, bind.trans[i]) && is_equal(r, bind.rot[i]) && is_equal(s, bind.scale[i]);
+		}
+	}
+
+	std::unordered_map<std::string, bool> name_folded;
+	for (int i = 0; i < n_nodes; ++i)
+	{
+		// channels bind by name, a duplicated name folds only if all its nodes do
+		auto itr = name_folded.insert({ nodes[i]->name, true }).first;
+		itr->second = itr->second && at_bind[i];
+	}
+	for (auto& anim : anims)
+	{
+		if (is_quantized(*anim)) {
+			continue;
+		}
+
+		auto& channels = anim->channels;
+		auto end = std::remove_if(channels.begin(), channels.end(), [&](const std::shared_ptr<const NodeAnim>& c) {
+			auto itr = name_folded.find(c->name);
+			return itr != name_folded.end() && itr->second;
+		});
+		st.folded += static_cast<int>(channels.end() - end);
+		channels.erase(end, channels.end());
+	}
+
+	// quantized clips keep their sampler
+	AnimList list;
+	list.reserve(anims.size());
+	for (auto& anim : anims)
+	{
+		if (!anim->sampler) {
+			anim->sampler = std::make_shared<PackedClip>(*anim);
+		}
+		list.push_back(std::move(anim));
+	}
+	m_anims = BindChannels(list);
+
+	return st;
+}
+
+void SkeletalAnim::CompressAnims(const CompressParams& params)
+{
+	auto& nodes = m_skeleton->nodes;
+	auto& bind  = m_skeleton->bind_pose;
+
+	// rotation error is measured at the farthest child joint
+	std::vector<float> bone_len(nodes.size(), 0);
+	for (size_t i = 0, n = nodes.size(); i < n; ++i)
+	{
+		int parent = nodes[i]->parent;
+		if (parent >= 0)
+		{
+			auto& t = bind.trans[i];
+			bone_len[parent] = std::max(bone_len[parent], sqrtf(t.x * t.x + t.y * t.y + t.z * t.z));
+		}
+	}
+
+	auto lerp_vec3 = [](const sm::vec3& a, const sm::vec3& b, float t) {
+		return a + (b - a) * t;
+	};
+	auto vec3_dist = [](const sm::vec3& a, const sm::vec3& b) {
+		auto d = a - b;
+		return sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	};
+	auto vec3_max_diff = [](const sm::vec3& a, const sm::vec3& b) {
+		return std::max(fabs(a.x - b.x), std::max(fabs(a.y - b.y), fabs(a.z - b.z)));
+	};
+	auto slerp = [](const sm::Quaternion& a, const sm::Quaternion& b, float t) {
+		sm::Quaternion q;
+		q.Slerp(a, b, t);
+		return q;
+	};
+
+	std::vector<std::unique_ptr<ModelExtend>> anims;
+	anims.reserve(m_anims->size());
+	for (auto& src : *m_anims)
+	{
+		if (is_quantized(*src))
+		{
+			anims.push_back(std::make_unique<ModelExtend>(*src));
+			continue;
+		}
+
+		std::vector<float> channel_len(src->channels.size(), 0);
+		for (size_t i = 0, n = nodes.size(); i < n; ++i) {
+			int c = src->node_to_channel[i];
+			if (c >= 0) {
+				channel_len[c] = std::max(channel_len[c], bone_len[i]);
+			}
+		}
+
+		auto dst = std::make_unique<ModelExtend>();
+		dst->name             = src->name;
+		dst->duration         = src->duration;
+		dst->ticks_per_second = src->ticks_per_second;
+		for (size_t i = 0, n = src->channels.size(); i < n; ++i)
+		{
+			auto c = std::make_shared<NodeAnim>(*src->channels[i]);
+			if (params.reduce_keys)
+			{
+				// tip moves 2 * sin(angle / 2) * len
+				const float len = channel_len[i] > 0 ? channel_len[i] : params.leaf_bone_length;
+				auto rot_dist = [len](const sm::Quaternion& a, const sm::Quaternion& b) {
+					float d = fabs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+					return 2 * sqrtf(std::max(0.0f, 1 - d * d)) * len;
+				};
+				reduce_keys(c->position_keys, params.pos_tolerance, lerp_vec3, vec3_dist);
+				reduce_keys(c->rotation_keys, params.rot_tolerance, slerp, rot_dist);
+				reduce_keys(c->scaling_keys, params.scale_tolerance, lerp_vec3, vec3_max_diff);
+			}
+			dst->channels.push_back(c);
+		}
+
+		if (params.quantize)
+		{
+			dst->sampler = std::make_shared<CompressedClip>(*dst);
+			for (auto& c : dst->channels)
+			{
+				auto name_only = std::make_shared<NodeAnim>();
+				name_only->name = c->name;
+				c = name_only;
+			}
+		}
+		else
+		{
+			dst->sampler = std::make_shared<PackedClip>(*dst);
+		}
+
+		anims.push_back(std::move(dst));
+	}
+
+	AnimList list;
+	list.reserve(anims.size());
+	for (auto& anim : anims) {
+		list.push_back(std::move(anim));
+	}
+	m_anims = BindChannels(list);
+}
+
+int SkeletalAnim::ResampleAnims(const ResampleParams& params)
+{
+	// offsets between grid frames where the error is checked
+	const float SUB_FRAMES[] = { 0.25f, 0.5f, 0.75f };
+
+	int n_resampled = 0;
+
+	auto anims = std::make_shared<AnimList>();
+	anims->reserve(m_anims->size());
+	for (auto& anim : *m_anims)
+	{
+		// too big a grid is known without baking it
+		auto& keyed = *anim->sampler;
+		const int n_frames = UniformClip::CalcNumFrames(*anim);
+		if (UniformClip::CalcMemSize(n_frames, keyed.GetNumChannels()) > keyed.GetMemSize() * params.max_mem_ratio)
+		{
+			anims->push_back(anim);
+			continue;
+		}
+
+		auto uniform = std::make_shared<UniformClip>(*anim, keyed);
+
+		bool accept = true;
+		if (uniform->GetNumFrames() > 1)
+		{
+			const int n = keyed.GetNumChannels();
+			std::vector<ClipSampler::Cursor> c0(n), c1(n);
+			std::vector<sm::vec3>       t0(n), t1(n), s0(n), s1(n);
+			std::vector<sm::Quaternion> r0(n), r1(n);
+
+			const float frame_time = anim->duration / (uniform->GetNumFrames() - 1);
+			for (int f = 0, nf = uniform->GetNumFrames() - 1; f < nf && accept; ++f)
+			{
+				for (auto sub : SUB_FRAMES)
+				{
+					const float time = (f + sub) * frame_time;
+					keyed.Sample(time, c0.data(), t0.data(), r0.data(), s0.data());
+					uniform->Sample(time, c1.data(), t1.data(), r1.data(), s1.data());
+					for (int i = 0; i < n && accept; ++i)
+					{
+						auto dt = t0[i] - t1[i];
+						auto ds = s0[i] - s1[i];
+						const float d = fabs(r0[i].x * r1[i].x + r0[i].y * r1[i].y + r0[i].z * r1[i].z + r0[i].w * r1[i].w);
+						const float err = std::max({
+							fabs(dt.x), fabs(dt.y), fabs(dt.z),
+							fabs(ds.x), fabs(ds.y), fabs(ds.z),
+							2 * sqrtf(std::max(0.0f, 1 - d * d))
+						});
+						accept = err <= params.tolerance;
+					}
+				}
+			}
+		}
+
+		if (accept)
+		{
+			auto dst = std::make_shared<ModelExtend>(*anim);
+			dst->sampler = uniform;
+			anims->push_back(dst);
+			++n_resampled;
+		}
+		else
+		{
+			anims->push_back(anim);
+		}
+	}
+	m_anims = anims;
+
+	return n_resampled;
+}
+
+size_t SkeletalAnim::GetAnimMemSize() const
+{
+	size_t sz = 0;
+	for (auto& anim : *m_anims)
+	{
+		if (anim->sampler) {
+			sz += anim->sampler->GetMemSize();
+		}
+		for (auto& c : anim->channels)
+		{
+			sz += sizeof(NodeAnim);
+			sz += c->position_keys.capacity() * sizeof(c->position_keys[0]);
+			sz += c->rotation_keys.capacity() * sizeof(c->rotation_keys[0]);
+			sz += c->scaling_keys.capacity() * sizeof(c->scaling_keys[0]);
+		}
+	}
+	return sz;
+}
+
+void SkeletalAnim::BakePoseCaches(bool model_space, bool quantize)
+{
+	auto space = model_space ? PoseCache::Space::Model : PoseCache::Space::Local;
+
+	auto anims = std::make_shared<AnimList>();
+	anims->reserve(m_anims->size());
+	for (auto& anim : *m_anims)
+	{
+		auto baked = std::make_shared<ModelExtend>(*anim);
+		baked->pose_cache = std::make_shared<PoseCache>(*this, *anim, space, quantize);
+		anims->push_back(baked);
+	}
+	m_anims = anims;
+}
+
+size_t SkeletalAnim::GetPoseCacheMemSize() const
+{
+	size_t sz = 0;
+	for (auto& anim : *m_anims) {
+		if (anim->pose_cache) {
+			sz += anim->pose_cache->GetMemSize();
+		}
+	}
+	return sz;
 }
 
 void SkeletalAnim::PrintNodeTree() const
 {
+	auto& nodes = m_skeleton->nodes;
 	printf("-----------------------------------\n");
-	for (size_t i = 0; i < m_nodes.size(); ++i)
+	for (size_t i = 0; i < nodes.size(); ++i)
 	{
 		printf("%d: ", i);
-		int parent = m_nodes[i]->parent;
+		int parent = nodes[i]->parent;
 		while (parent != -1) {
 			printf("%d ", parent);
-			parent = m_nodes[parent]->parent;
+			parent = nodes[parent]->parent;
 		}
 		printf("\n");
 	}
 	printf("-----------------------------------\n");
 }
 
-void SkeletalAnim::InitTPoseTrans()
+void SkeletalAnim::CalcGlobalTrans(const Pose& local_pose,
+	                               std::vector<sm::mat4>& global_trans, int root) const
+{
+	auto& sk = *m_skeleton;
+	assert(local_pose.Size() == sk.nodes.size());
+	if (global_trans.size() != local_pose.Size()) {
+		global_trans.resize(local_pose.Size());
+		root = -1;
+	}
+
+	int begin = 0, end = static_cast<int>(sk.eval_order.size());
+	if (root >= 0) {
+		begin = sk.subtree_range[root].first;
+		end   = sk.subtree_range[root].second;
+	}
+
+	for (int i = begin; i < end; ++i)
+	{
+		const int node   = sk.eval_order[i];
+		const int parent = sk.eval_parent[i];
+		auto local = ComposeTrans(local_pose.trans[node], local_pose.rot[node], local_pose.scale[node]);
+		if (parent < 0) {
+			global_trans[node] = local;
+		} else {
+			global_trans[node] = global_trans[parent] * local; // mat mul
+		}
+	}
+}
+
+sm::mat4 SkeletalAnim::ComposeTrans(const sm::vec3& trans, const sm::Quaternion& rot, const sm::vec3& scale)
+{
+	auto& p = trans;
+	auto& s = scale;
+	sm::mat4 m(rot);
+    m.c[0][0] *= s.x; m.c[1][0] *= s.y; m.c[2][0] *= s.z; m.c[3][0] = p.x;
+    m.c[0][1] *= s.x; m.c[1][1] *= s.y; m.c[2][1] *= s.z; m.c[3][1] = p.y;
+    m.c[0][2] *= s.x; m.c[1][2] *= s.y; m.c[2][2] *= s.z; m.c[3][2] = p.z;
+    m.c[0][3]  = 0;   m.c[1][3]  = 0;   m.c[2][3]  = 0;   m.c[3][3] = 1;
+	return m;
+}
+
+void SkeletalAnim::DecomposeTrans(const sm::mat4& mat, sm::vec3& trans, sm::Quaternion& rot, sm::vec3& scale)
+{
+	trans.x = mat.c[3][0];
+	trans.y = mat.c[3][1];
+	trans.z = mat.c[3][2];
+
+	float s[3];
+	for (int i = 0; i < 3; ++i) {
+		s[i] = sqrtf(mat.c[i][0] * mat.c[i][0] + mat.c[i][1] * mat.c[i][1] + mat.c[i][2] * mat.c[i][2]);
+	}
+	scale.x = s[0];
+	scale.y = s[1];
+	scale.z = s[2];
+
+	// rotation matrix, r[row][col]
+	float r[3][3];
+	for (int col = 0; col < 3; ++col) {
+		const float inv = s[col] > 0 ? 1.0f / s[col] : 0;
+		for (int row = 0; row < 3; ++row) {
+			r[row][col] = mat.c[col][row] * inv;
+		}
+	}
+
+	const float tr = r[0][0] + r[1][1] + r[2][2];
+	if (tr > 0)
+	{
+		float k = sqrtf(tr + 1.0f) * 2;
+		rot.w = 0.25f * k;
+		rot.x = (r[2][1] - r[1][2]) / k;
+		rot.y = (r[0][2] - r[2][0]) / k;
+		rot.z = (r[1][0] - r[0][1]) / k;
+	}
+	else if (r[0][0] > r[1][1] && r[0][0] > r[2][2])
+	{
+		float k = sqrtf(1.0f + r[0][0] - r[1][1] - r[2][2]) * 2;
+		rot.w = (r[2][1] - r[1][2]) / k;
+		rot.x = 0.25f * k;
+		rot.y = (r[0][1] + r[1][0]) / k;
+		rot.z = (r[0][2] + r[2][0]) / k;
+	}
+	else if (r[1][1] > r[2][2])
+	{
+		float k = sqrtf(1.0f + r[1][1] - r[0][0] - r[2][2]) * 2;
+		rot.w = (r[0][2] - r[2][0]) / k;
+		rot.x = (r[0][1] + r[1][0]) / k;
+		rot.y = 0.25f * k;
+		rot.z = (r[1][2] + r[2][1]) / k;
+	}
+	else
+	{
+		float k = sqrtf(1.0f + r[2][2] - r[0][0] - r[1][1]) * 2;
+		rot.w = (r[1][0] - r[0][1]) / k;
+		rot.x = (r[0][2] + r[2][0]) / k;
+		rot.y = (r[1][2] + r[2][1]) / k;
+		rot.z = 0.25f * k;
+	}
+}
+
+void SkeletalAnim::InitEvalOrder(Skeleton& sk)
+{
+	auto& nodes = sk.nodes;
+	const int n = static_cast<int>(nodes.size());
+
+	std::vector<std::vector<int>> children(n);
+	for (int i = 0; i < n; ++i)
+	{
+		int parent = nodes[i]->parent;
+		if (parent >= 0) {
+			children[parent].push_back(i);
+		}
+	}
+
+	sk.eval_order.clear();
+	sk.eval_order.reserve(n);
+	sk.eval_parent.clear();
+	sk.eval_parent.reserve(n);
+	sk.subtree_range.assign(n, { 0, 0 });
+
+	std::vector<int> stack;
+	for (int i = 0; i < n; ++i)
+	{
+		if (nodes[i]->parent >= 0) {
+			continue;
+		}
+
+		stack.push_back(i);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+
+			sk.subtree_range[node].first = static_cast<int>(sk.eval_order.size());
+			sk.eval_order.push_back(node);
+			sk.eval_parent.push_back(nodes[node]->parent);
+
+			for (auto itr = children[node].rbegin(); itr != children[node].rend(); ++itr) {
+				stack.push_back(*itr);
+			}
+		}
+	}
+	assert(sk.eval_order.size() == nodes.size());
+
+	// children come after their parent, so walk backwards to accumulate subtree sizes
+	std::vector<int> subtree_sz(n, 1);
+	sk.node_height.assign(n, 0);
+	for (int i = n - 1; i >= 0; --i)
+	{
+		int node = sk.eval_order[i];
+		int parent = sk.eval_parent[i];
+		if (parent >= 0)
+		{
+			subtree_sz[parent] += subtree_sz[node];
+			sk.node_height[parent] = std::max(sk.node_height[parent], sk.node_height[node] + 1);
+		}
+		sk.subtree_range[node].second = sk.subtree_range[node].first + subtree_sz[node];
+	}
+}
+
+void SkeletalAnim::InitTPoseTrans(Skeleton& sk) const
 {
 	std::vector<sm::mat4> tpose_local_trans;
-	tpose_local_trans.resize(m_nodes.size());
-	for (size_t i = 0; i < m_nodes.size(); ++i)
+	tpose_local_trans.resize(sk.nodes.size());
+	for (size_t i = 0; i < sk.nodes.size(); ++i)
 	{
 		sm::vec3 pos, rot, scale;
-		m_nodes[i]->local_trans.Decompose(pos, rot, scale);
+		sk.nodes[i]->local_trans.Decompose(pos, rot, scale);
 
 		auto& d = tpose_local_trans[i];
         d.c[0][0] = scale.x; d.c[1][0] = 0;       d.c[2][0] = 0;       d.c[3][0] = pos.x;
@@ -65,17 +726,75 @@ void SkeletalAnim::InitTPoseTrans()
         d.c[0][3] = 0;       d.c[1][3] = 0;       d.c[2][3] = 0;       d.c[3][3] = 1;
 	}
 
-	m_tpose_world_trans.resize(m_nodes.size());
-	for (size_t i = 0; i < m_nodes.size(); ++i)
+	sk.tpose_world_trans.clear();
+	CalcGlobalTrans(tpose_local_trans, sk.tpose_world_trans);
+}
+
+std::shared_ptr<const SkeletalAnim::AnimList>
+SkeletalAnim::BindChannels(const AnimList& anims) const
+{
+	auto& nodes = m_skeleton->nodes;
+
+	auto ret = std::make_shared<AnimList>();
+	ret->reserve(anims.size());
+
+	std::unordered_map<std::string, int> name2channel;
+	for (auto& anim : anims)
 	{
-		auto g_trans = tpose_local_trans[i];
-		int parent = m_nodes[i]->parent;
-		while (parent != -1) {
-			g_trans = tpose_local_trans[parent] * g_trans;
-			parent = m_nodes[parent]->parent;
+		name2channel.clear();
+		for (int i = 0, n = anim->channels.size(); i < n; ++i) {
+			// the last channel wins, same as the old per-instance binding
+			name2channel[anim->channels[i]->name] = i;
+		}
+
+		auto bound = std::make_shared<ModelExtend>(*anim);
+		bound->node_to_channel.assign(nodes.size(), -1);
+		bound->lod_channel_mask.assign(MAX_LOD_TIER, std::vector<uint8_t>(anim->channels.size(), 0));
+		for (int i = 0, n = nodes.size(); i < n; ++i)
+		{
+			auto itr = name2channel.find(nodes[i]->name);
+			if (itr == name2channel.end()) {
+				continue;
+			}
+
+			const int c = itr->second;
+			bound->node_to_channel[i] = c;
+			for (int tier = 1; tier <= MAX_LOD_TIER; ++tier) {
+				if (m_skeleton->node_height[i] >= tier) {
+					bound->lod_channel_mask[tier - 1][c] = 1;
+				}
+			}
 		}
-		m_tpose_world_trans[i] = g_trans;
+		ret->push_back(bound);
+	}
+
+	return ret;
+}
+
+void SkeletalAnim::SortChannelsByLod(ModelExtend& anim) const
+{
+	auto& nodes = m_skeleton->nodes;
+	if (nodes.empty()) {
+		return;
 	}
+
+	// highest tier a channel is sampled at, -1 if it drives no node
+	std::unordered_map<std::string, int> name2tier;
+	for (int i = 0, n = nodes.size(); i < n; ++i)
+	{
+		auto itr = name2tier.insert({ nodes[i]->name, -1 }).first;
+		itr->second = std::max(itr->second, std::min(m_skeleton->node_height[i], MAX_LOD_TIER));
+	}
+	auto tier = [&](const std::shared_ptr<const NodeAnim>& c) {
+		auto itr = name2tier.find(c->name);
+		return itr == name2tier.end() ? -1 : itr->second;
+	};
+
+	// stable, channels with the same name keep their order
+	std::stable_sort(anim.channels.begin(), anim.channels.end(),
+		[&](const std::shared_ptr<const NodeAnim>& a, const std::shared_ptr<const NodeAnim>& b) {
+			return tier(a) > tier(b);
+		});
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,271 @@
+#include "model/StagedModel.h"
+#include "model/AssimpHelper.h"
+#include "model/CookedModel.h"
+#include "model/GltfLoader.h"
+#include "model/typedef.h"
+#ifndef NO_FBX
+#include "model/FbxLoader.h"
+#include "model/BlendShapeLoader.h"
+#endif
+
+#include <unirender/Device.h>
+#include <unirender/VertexArray.h>
+#include <unirender/IndexBuffer.h>
+#include <unirender/VertexBuffer.h>
+#include <unirender/VertexInputAttribute.h>
+
+#include <algorithm>
+#include <filesystem>
+
+namespace model
+{
+
+const void* StagedModel::MeshBuffers::GetIndexData() const
+{
+	if (index_data32) {
+		return index_data32;
+	} else if (index_data) {
+		return index_data;
+	} else if (!indices32.empty()) {
+		return indices32.data();
+	} else {
+		return indices.data();
+	}
+}
+
+size_t StagedModel::MeshBuffers::GetIndexCount() const
+{
+	if (index_data || index_data32) {
+		return index_count;
+	} else {
+		return indices32.empty() ? indices.size() : indices32.size();
+	}
+}
+
+std::unique_ptr<StagedModel> StagedModel::Load(const std::string& filepath, const LoadOptions& opts)
+{
+	auto staged = std::make_unique<StagedModel>();
+	staged->filepath = filepath;
+	staged->model = std::make_unique<Model>(nullptr);
+
+	// same dispatch as Model::LoadFromFile()
+	if (IsDeferred(filepath))
+	{
+		staged->deferred = true;
+		return staged;
+	}
+
+	auto ext = std::filesystem::path(filepath).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), tolower);
+	if (ext == ".cooked") {
+		return CookedModel::Load(*staged, filepath) ? std::move(staged) : nullptr;
+	}
+	if (ext == ".gltf") {
+		return GltfLoader::Load(*staged, filepath) ? std::move(staged) : nullptr;
+	}
+
+	if (!AssimpHelper::Load(*staged, filepath, 1.0f, opts)) {
+		return nullptr;
+	}
+
+#ifndef NO_FBX
+	if (ext == ".fbx")
+	{
+		std::vector<std::unique_ptr<BlendShapeLoader::MeshData>> meshes;
+		FbxLoader::LoadBlendShapeMeshes(meshes, filepath);
+		BlendShapeLoader::Load(*staged->model, meshes);
+	}
+#endif
+
+	return staged;
+}
+
+std::shared_ptr<Model> StagedModel::Upload(const ur::Device& dev)
+{
+	if (!model) {
+		return nullptr;
+	}
+
+	model->dev = &dev;
+	if (deferred)
+	{
+		if (!model->LoadFromFile(filepath)) {
+			return nullptr;
+		}
+	}
+	else
+	{
+		UploadResources(dev, *model);
+	}
+
+	return std::shared_ptr<Model>(std::move(model));
+}
+
+void StagedModel::UploadResources(const ur::Device& dev, Model& dst)
+{
+	for (auto& t : textures)
+	{
+		if (t.tex >= 0 && t.tex < static_cast<int>(dst.textures.size())) {
+			dst.textures[t.tex].second = TextureLoader::Upload(dev, t.image);
+		}
+	}
+	textures.clear();
+
+	for (auto& mb : meshes)
+	{
+		if (mb.mesh < 0 || mb.mesh >= static_cast<int>(dst.meshes.size())) {
+			continue;
+		}
+		auto& geo = dst.meshes[mb.mesh]->geometry;
+		geo.vertex_array = CreateVertexArray(dev, geo, mb);
+	}
+	meshes.clear();
+}
+
+std::shared_ptr<ur::VertexArray>
+StagedModel::CreateVertexArray(const ur::Device& dev, const MeshGeometry& geo, const MeshBuffers& buffers)
+{
+	auto va = dev.CreateVertexArray();
+
+	auto ibuf_sz = buffers.GetIndexBytes();
+	auto ibuf = dev.CreateIndexBuffer(ur::BufferUsageHint::StaticDraw, ibuf_sz);
+	ibuf->ReadFromMemory(buffers.GetIndexData(), ibuf_sz, 0);
+	if (buffers.HasIndices32()) {
+		ibuf->SetDataType(ur::IndexBufferDataType::UnsignedInt);
+	}
+	ibuf->SetCount(static_cast<int>(buffers.GetIndexCount()));
+	va->SetIndexBuffer(ibuf);
+
+	auto vbuf_sz = geo.vert_stride * geo.n_vert;
+	auto vbuf = dev.CreateVertexBuffer(ur::BufferUsageHint::StaticDraw, vbuf_sz);
+	vbuf->ReadFromMemory(geo.vert_buf, vbuf_sz, 0);
+	va->SetVertexBuffer(vbuf);
+
+	va->SetVertexBufferAttrs(buffers.attrs);
+
+	return va;
+}
+
+bool StagedModel::IsDeferred(const std::string& filepath)
+{
+	auto ext = std::filesystem::path(filepath).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), tolower);
+	return ext == ".param" || ext == ".m3d" || ext == ".xml"
+#ifndef NO_QUAKE
+		|| ext == ".mdl" || ext == ".bsp" || ext == ".map"
+#endif // NO_QUAKE
+		;
+}
+
+StagedModel::UploadStats StagedModel::GetUploadStats() const
+{
+	UploadStats st;
+	if (!model) {
+		return st;
+	}
+
+	for (auto& t : textures)
+	{
+		if (t.tex < 0 || t.tex >= static_cast<int>(model->textures.size()) || !t.image.pixels) {
+			continue;
+		}
+		++st.textures;
+		st.texture_bytes += t.image.GetSizeInBytes();
+	}
+
+	// same as UploadResources()
+	for (auto& mb : meshes)
+	{
+		if (mb.mesh < 0 || mb.mesh >= static_cast<int>(model->meshes.size())) {
+			continue;
+		}
+		auto& geo = model->meshes[mb.mesh]->geometry;
+
+		++st.vertex_arrays;
+		++st.index_buffers;
+		++st.vertex_buffers;
+		st.index_bytes  += mb.GetIndexBytes();
+		st.vertex_bytes += static_cast<size_t>(geo.vert_stride) * geo.n_vert;
+	}
+
+	return st;
+}
+
+std::vector<std::shared_ptr<ur::VertexInputAttribute>>
+StagedModel::BuildVertexAttrs(unsigned int vertex_type, int& stride)
+{
+	stride = 0;
+	// pos
+	stride += 4 * 3;
+	// normal
+	if (vertex_type & VERTEX_FLAG_NORMALS) {
+		stride += 4 * 3;
+	}
+	// texcoord
+	if (vertex_type & VERTEX_FLAG_TEXCOORDS0) {
+		stride += 4 * 2;
+	}
+	if (vertex_type & VERTEX_FLAG_TEXCOORDS1) {
+		stride += 4 * 2;
+	}
+	// color
+	if (vertex_type & VERTEX_FLAG_COLOR) {
+		stride += 4;
+	}
+	// skinned
+	if (vertex_type & VERTEX_FLAG_SKINNED) {
+		stride += 4 + 4;
+	}
+
+	std::vector<std::shared_ptr<ur::VertexInputAttribute>> attrs;
+
+	int offset = 0;
+	int attr_loc = 0;
+	// pos
+	attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+		attr_loc++, ur::ComponentDataType::Float, 3, offset, stride));
+	offset += 4 * 3;
+	// normal
+	if (vertex_type & VERTEX_FLAG_NORMALS)
+	{
+		attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+			attr_loc++, ur::ComponentDataType::Float, 3, offset, stride));
+		offset += 4 * 3;
+	}
+	// texcoord
+	if (vertex_type & VERTEX_FLAG_TEXCOORDS0)
+	{
+		attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+			attr_loc++, ur::ComponentDataType::Float, 2, offset, stride));
+		offset += 4 * 2;
+	}
+	if (vertex_type & VERTEX_FLAG_TEXCOORDS1)
+	{
+		attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+			attr_loc++, ur::ComponentDataType::Float, 2, offset, stride));
+		offset += 4 * 2;
+	}
+	// color
+	if (vertex_type & VERTEX_FLAG_COLOR)
+	{
+		attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+			attr_loc++, ur::ComponentDataType::UnsignedByte, 4, offset, stride));
+		offset += 4;
+	}
+	// skinned
+	if (vertex_type & VERTEX_FLAG_SKINNED)
+	{
+		// blend_indices
+		attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+			attr_loc++, ur::ComponentDataType::UnsignedByte, 4, offset, stride));
+		offset += 4;
+		// blend_weights
+		attrs.push_back(std::make_shared<ur::VertexInputAttribute>(
+			attr_loc++, ur::ComponentDataType::UnsignedByte, 4, offset, stride));
+		offset += 4;
+	}
+
+	return attrs;
+}
+
+}
@@ -15,6 +15,15 @@ namespace model
 
 ur::TexturePtr
 TextureLoader::LoadFromFile(const ur::Device& dev, const char* filepath, int mipmap_levels)
+{
+	Image image;
+	if (!DecodeFile(filepath, image)) {
+		return nullptr;
+	}
+	return Upload(dev, image);
+}
+
+bool TextureLoader::DecodeFile(const char* filepath, Image& image)
 {
 	if (!std::filesystem::is_regular_file(filepath)) {
 		return false;
@@ -76,16 +85,62 @@ TextureLoader::LoadFromFile(const ur::Device& dev, const char* filepath, int mip
 		GD_REPORT_ASSERT("unknown type.");
 	}
 
-    ur::TextureDescription desc;
-    desc.target = ur::TextureTarget::Texture2D;
-    desc.width  = w;
-    desc.height = h;
-    desc.format = tf;
-	ur::TexturePtr ret = dev.CreateTexture(desc, pixels);
+	image.width  = w;
+	image.height = h;
+	image.format = tf;
+	image.pixels.reset(pixels, free);
+
+	return true;
+}
+
+size_t TextureLoader::Image::GetSizeInBytes() const
+{
+	if (!pixels) {
+		return 0;
+	}
 
-	free(pixels);
+	const size_t n = static_cast<size_t>(width) * height;
+	// 4x4 blocks
+	const size_t n_blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+	switch (format)
+	{
+	case ur::TextureFormat::A8:
+	case ur::TextureFormat::RED:
+		return n;
+	case ur::TextureFormat::R16:
+		return n * 2;
+	case ur::TextureFormat::RGB:
+	case ur::TextureFormat::BGR_EXT:
+		return n * 3;
+	case ur::TextureFormat::RGB16F:
+		return n * 6;
+	case ur::TextureFormat::RGBA16:
+	case ur::TextureFormat::RGBA16F:
+		return n * 8;
+	case ur::TextureFormat::RGB32F:
+		return n * 12;
+	case ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return n_blocks * 8;
+	case ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return n_blocks * 16;
+	default:
+		return n * 4;
+	}
+}
 
-	return ret;
+ur::TexturePtr TextureLoader::Upload(const ur::Device& dev, const Image& image)
+{
+	if (!image.pixels) {
+		return nullptr;
+	}
+
+    ur::TextureDescription desc;
+    desc.target = ur::TextureTarget::Texture2D;
+    desc.width  = image.width;
+    desc.height = image.height;
+    desc.format = image.format;
+	return dev.CreateTexture(desc, image.pixels.get());
 }
 
 ur::TexturePtr
@@ -0,0 +1,105 @@
+#include "model/UniformClip.h"
+
+#include <algorithm>
+
+#include <math.h>
+
+namespace model
+{
+
+UniformClip::UniformClip(const SkeletalAnim::ModelExtend& anim, const ClipSampler& src)
+	: m_duration(anim.duration)
+	, m_num_channels(src.GetNumChannels())
+{
+	m_num_frames = CalcNumFrames(anim);
+	m_rate = m_num_frames > 1 && m_duration > 0 ? (m_num_frames - 1) / m_duration : 0;
+
+	BakeFrames(src, m_duration, m_num_frames, m_data);
+}
+
+void UniformClip::Sample(float time, Cursor* cursors, sm::vec3* trans,
+	                     sm::Quaternion* rot, sm::vec3* scale, const uint8_t* channel_mask) const
+{
+	int frame = 0;
+	float f = 0;
+	if (m_num_frames > 1)
+	{
+		const float ft = std::min(std::max(time * m_rate, 0.0f), static_cast<float>(m_num_frames - 1));
+		frame = std::min(static_cast<int>(ft), m_num_frames - 2);
+		f = ft - frame;
+	}
+
+	const int next = std::min(frame + 1, m_num_frames - 1);
+	const float* a = &m_data[static_cast<size_t>(frame) * m_num_channels * STRIDE];
+	const float* b = &m_data[static_cast<size_t>(next) * m_num_channels * STRIDE];
+	for (int i = 0; i < m_num_channels; ++i, a += STRIDE, b += STRIDE)
+	{
+		if (channel_mask && !channel_mask[i]) {
+			continue;
+		}
+
+		float v[STRIDE];
+		for (int j = 0; j < STRIDE; ++j) {
+			v[j] = a[j] + (b[j] - a[j]) * f;
+		}
+
+		trans[i].x = v[0]; trans[i].y = v[1]; trans[i].z = v[2];
+		const float len2 = v[3] * v[3] + v[4] * v[4] + v[5] * v[5] + v[6] * v[6];
+		const float inv_len = len2 > 0 ? 1.0f / sqrtf(len2) : 0;
+		rot[i].x = v[3] * inv_len; rot[i].y = v[4] * inv_len;
+		rot[i].z = v[5] * inv_len; rot[i].w = v[6] * inv_len;
+		scale[i].x = v[7]; scale[i].y = v[8]; scale[i].z = v[9];
+	}
+}
+
+size_t UniformClip::GetMemSize() const
+{
+	return sizeof(UniformClip) + m_data.capacity() * sizeof(float);
+}
+
+int UniformClip::CalcNumFrames(const SkeletalAnim::ModelExtend& anim)
+{
+	return std::max(1, anim.GetMaxFrameCount());
+}
+
+size_t UniformClip::CalcMemSize(int num_frames, int num_channels)
+{
+	return sizeof(UniformClip) + static_cast<size_t>(num_frames) * num_channels * STRIDE * sizeof(float);
+}
+
+void UniformClip::BakeFrames(const ClipSampler& src, float duration, int num_frames,
+	                         std::vector<float>& dst)
+{
+	const int n_channels = src.GetNumChannels();
+	std::vector<Cursor>         cursors(n_channels);
+	std::vector<sm::vec3>       trans(n_channels);
+	std::vector<sm::Quaternion> rot(n_channels);
+	std::vector<sm::vec3>       scale(n_channels);
+
+	dst.resize(static_cast<size_t>(num_frames) * n_channels * STRIDE);
+	float* ptr = dst.data();
+	for (int f = 0; f < num_frames; ++f)
+	{
+		const float time = num_frames > 1 ? duration * f / (num_frames - 1) : 0;
+		src.Sample(time, cursors.data(), trans.data(), rot.data(), scale.data());
+
+		for (int i = 0; i < n_channels; ++i, ptr += STRIDE)
+		{
+			auto& t = trans[i];
+			auto& s = scale[i];
+			auto q = rot[i];
+			if (f > 0)
+			{
+				const float* prev = ptr - static_cast<size_t>(n_channels) * STRIDE;
+				if (prev[3] * q.x + prev[4] * q.y + prev[5] * q.z + prev[6] * q.w < 0) {
+					q.x = -q.x; q.y = -q.y; q.z = -q.z; q.w = -q.w;
+				}
+			}
+			ptr[0] = t.x; ptr[1] = t.y; ptr[2] = t.z;
+			ptr[3] = q.x; ptr[4] = q.y; ptr[5] = q.z; ptr[6] = q.w;
+			ptr[7] = s.x; ptr[8] = s.y; ptr[9] = s.z;
+		}
+	}
+}
+
+}
@@ -0,0 +1,119 @@
+#include "model/WorkerPool.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// set while the thread runs chunks of a loop, a nested loop then runs inline
+thread_local bool t_in_loop = false;
+
+}
+
+namespace model
+{
+
+WorkerPool::WorkerPool(int thread_count)
+	: m_next(0)
+{
+	if (thread_count <= 0) {
+		thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	m_workers.reserve(thread_count - 1);
+	for (int i = 1; i < thread_count; ++i) {
+		m_workers.emplace_back(&WorkerPool::WorkerLoop, this);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_start_cv.notify_all();
+
+	for (auto& t : m_workers) {
+		t.join();
+	}
+}
+
+void WorkerPool::Run(size_t n, size_t chunk_size, ChunkFunc func, const void* f)
+{
+	if (n == 0) {
+		return;
+	}
+	chunk_size = std::max<size_t>(chunk_size, 1);
+
+	// not worth waking the pool, or called from a chunk, whose loop holds
+	// m_run_mutex and waits for this thread
+	if (m_workers.empty() || n <= chunk_size || t_in_loop)
+	{
+		func(f, 0, n);
+		return;
+	}
+
+	std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_count      = n;
+		m_chunk_size = chunk_size;
+		m_func       = func;
+		m_func_data  = f;
+		m_next.store(0, std::memory_order_relaxed);
+		m_busy = static_cast<int>(m_workers.size());
+		++m_generation;
+	}
+	m_start_cv.notify_all();
+
+	RunChunks();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done_cv.wait(lock, [&] { return m_busy == 0; });
+
+	m_func      = nullptr;
+	m_func_data = nullptr;
+}
+
+void WorkerPool::WorkerLoop()
+{
+	uint64_t generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_start_cv.wait(lock, [&] { return m_quit || m_generation != generation; });
+			if (m_quit) {
+				return;
+			}
+			generation = m_generation;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_busy == 0) {
+				m_done_cv.notify_one();
+			}
+		}
+	}
+}
+
+void WorkerPool::RunChunks()
+{
+	t_in_loop = true;
+	while (true)
+	{
+		const size_t begin = m_next.fetch_add(m_chunk_size, std::memory_order_relaxed);
+		if (begin >= m_count) {
+			break;
+		}
+		m_func(m_func_data, begin, std::min(begin + m_chunk_size, m_count));
+	}
+	t_in_loop = false;
+}
+
+}
@@ -0,0 +1,144 @@
+// Steady state updates must not allocate. Counts global operator new calls
+// around warmed-up Update() and CalcPalettes() calls of a procedural rig,
+// for single clip playback, LOD, cross-fades with layers and published poses.
+
+#include "SyntheticRig.h"
+
+#include <model/ModelInstance.h>
+#include <model/TimeContext.h>
+
+#include <atomic>
+#include <functional>
+#include <new>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace
+{
+
+std::atomic<bool>   g_counting(false);
+std::atomic<size_t> g_allocs(0);
+
+void* counted_alloc(size_t size)
+{
+	if (g_counting.load(std::memory_order_relaxed)) {
+		g_allocs.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (void* p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void  operator delete(void* p) noexcept { free(p); }
+void  operator delete[](void* p) noexcept { free(p); }
+void  operator delete(void* p, size_t) noexcept { free(p); }
+void  operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace
+{
+
+const int WARMUP_FRAMES = 8;
+const int FRAMES = 240;
+
+// frames run by step(time) after warm up, return the allocations counted
+size_t count_allocs(const std::function<void(float)>& step)
+{
+	float time = 0;
+	for (int i = 0; i < WARMUP_FRAMES; ++i) {
+		step(time += 1.0f / 60);
+	}
+
+	g_allocs = 0;
+	g_counting = true;
+	for (int i = 0; i < FRAMES; ++i) {
+		step(time += 1.0f / 60);
+	}
+	g_counting = false;
+
+	return g_allocs;
+}
+
+bool check(const char* name, size_t allocs)
+{
+	printf("%-24s %zu allocations in %d frames\n", name, allocs, FRAMES);
+	return allocs == 0;
+}
+
+}
+
+int main()
+{
+	synthetic::RigParams params;
+	params.nodes = 48;
+	params.clips = 3;
+	params.vertices = 64;
+	auto model = synthetic::CreateRig(params);
+
+	bool ok = true;
+
+	// single clip
+	{
+		model::ModelInstance inst(model, 0);
+		std::vector<float> palette(inst.GetPaletteSize() * 16);
+		model::TimeContext ctx;
+		ok &= check("clip + palettes", count_allocs([&](float time) {
+			ctx.time = time;
+			inst.Update(ctx);
+			inst.CalcPalettes(palette.data(), model::ModelInstance::PaletteFormat::Mat3x4);
+		}));
+	}
+
+	// LOD tiers and interpolated updates between full ones
+	{
+		model::ModelInstance inst(model, 1);
+		model::ModelInstance::AnimLod lod;
+		lod.tier = 1;
+		lod.update_interval = 3;
+		inst.SetAnimLod(lod);
+		model::TimeContext ctx;
+		ok &= check("lod", count_allocs([&](float time) {
+			ctx.time = time;
+			inst.Update(ctx);
+		}));
+	}
+
+	// cross-fade under an additive and a masked override layer
+	{
+		model::ModelInstance inst(model, 0);
+		inst.Update(0);
+		auto mask = std::make_shared<std::vector<float>>(params.nodes, 0.5f);
+		inst.AddLayer(1, model::ModelInstance::BlendMode::Additive, 0.5f);
+		inst.AddLayer(2, model::ModelInstance::BlendMode::Override, 0.7f, mask);
+		inst.CrossFade(1, 100.0f);
+		model::TimeContext ctx;
+		ok &= check("cross-fade + layers", count_allocs([&](float time) {
+			ctx.time = time;
+			inst.Update(ctx);
+		}));
+	}
+
+	// published poses, palettes on the reader side
+	{
+		model::ModelInstance inst(model, 2);
+		inst.SetAutoPublishPose(true);
+		std::vector<float> palette(inst.GetPaletteSize() * 16);
+		model::TimeContext ctx;
+		ok &= check("publish + snapshot", count_allocs([&](float time) {
+			ctx.time = time;
+			inst.Update(ctx);
+			if (auto pose = inst.AcquirePose()) {
+				inst.CalcPalettes(*pose, palette.data());
+			}
+		}));
+	}
+
+	printf(ok ? "passed\n" : "FAILED\n");
+	return ok ? 0 : 1;
+}
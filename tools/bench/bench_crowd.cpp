@@ -0,0 +1,141 @@
+// Crowd update scaling of InstanceUpdater over thread counts.
+//
+//   model_bench_crowd [--instances N] [--nodes N] [--frames N] [--max-threads N] [--palettes]
+//
+// One line per thread count 1, 2, 4 .. max-threads (default 32): time per
+// frame, instances per second, speedup over one thread and the efficiency.
+
+#include "SyntheticRig.h"
+
+#include <model/InstanceUpdater.h>
+#include <model/ModelInstance.h>
+#include <model/TimeContext.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+
+struct Options
+{
+	int instances = 4096;
+	int nodes = 64;
+	int frames = 120;
+	int max_threads = 32;
+
+	// CalcPalettes() after each instance's update
+	bool palettes = false;
+
+}; // Options
+
+bool parse_args(int argc, char* argv[], Options& opts)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool has_val = i + 1 < argc;
+		if (strcmp(argv[i], "--instances") == 0 && has_val) {
+			opts.instances = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--nodes") == 0 && has_val) {
+			opts.nodes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--frames") == 0 && has_val) {
+			opts.frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--max-threads") == 0 && has_val) {
+			opts.max_threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--palettes") == 0) {
+			opts.palettes = true;
+		} else {
+			return false;
+		}
+	}
+	return opts.instances > 0 && opts.nodes > 0 && opts.frames > 0 && opts.max_threads > 0;
+}
+
+// ms per frame
+double run(model::InstanceUpdater& updater, const std::vector<model::ModelInstance*>& instances,
+	       const std::function<void(model::ModelInstance&)>& post_update, int frames, float& time)
+{
+	model::TimeContext ctx;
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < frames; ++i)
+	{
+		time += 1.0f / 60;
+		ctx.time = time;
+		updater.UpdateInstances(instances, ctx, post_update);
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / frames;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	if (!parse_args(argc, argv, opts))
+	{
+		fprintf(stderr, "usage: model_bench_crowd [--instances N] [--nodes N] [--frames N] [--max-threads N] [--palettes]\n");
+		return 2;
+	}
+
+	synthetic::RigParams params;
+	params.nodes = opts.nodes;
+	params.vertices = opts.palettes ? 1 : 0;
+	auto model = synthetic::CreateRig(params);
+
+	std::vector<std::unique_ptr<model::ModelInstance>> owned;
+	std::vector<model::ModelInstance*> instances;
+	for (int i = 0; i < opts.instances; ++i)
+	{
+		owned.push_back(std::make_unique<model::ModelInstance>(model, i % params.clips));
+		// spread the crowd over the clip
+		owned.back()->SetStartTime(-0.013f * i);
+		instances.push_back(owned.back().get());
+	}
+
+	// one palette buffer per instance, looked up read-only by the workers
+	std::vector<std::vector<float>> palettes;
+	std::unordered_map<const model::ModelInstance*, size_t> palette_idx;
+	std::function<void(model::ModelInstance&)> post_update = nullptr;
+	if (opts.palettes)
+	{
+		palettes.assign(opts.instances, std::vector<float>(owned[0]->GetPaletteSize() * 16));
+		for (int i = 0; i < opts.instances; ++i) {
+			palette_idx[instances[i]] = i;
+		}
+		post_update = [&](model::ModelInstance& inst) {
+			inst.CalcPalettes(palettes[palette_idx.at(&inst)].data());
+		};
+	}
+
+	printf("%d instances, %d nodes, %d frames, %u hardware threads%s\n", opts.instances, opts.nodes,
+		opts.frames, std::thread::hardware_concurrency(), opts.palettes ? ", palettes" : "");
+	printf("%8s %12s %14s %8s %8s\n", "threads", "ms/frame", "instances/s", "speedup", "eff");
+
+	float time = 0;
+	double base_ms = 0;
+	for (int threads = 1; threads <= opts.max_threads; threads *= 2)
+	{
+		model::InstanceUpdater updater(threads);
+
+		// warm up caches and the instances' scratch buffers
+		run(updater, instances, post_update, 4, time);
+
+		const double ms = run(updater, instances, post_update, opts.frames, time);
+		if (threads == 1) {
+			base_ms = ms;
+		}
+		const double speedup = base_ms / ms;
+		printf("%8d %12.3f %14.0f %8.2f %7.0f%%\n", threads, ms, opts.instances * 1000.0 / ms,
+			speedup, speedup / threads * 100);
+	}
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+// CpuSkinning throughput over mesh sizes and WorkerPool thread counts.
+//
+//   model_bench_skinning [--nodes N] [--iterations N] [--max-threads N] [--no-normals]
+//
+// One line per mesh of 10k, 100k and 1M vertices and thread count 1, 2, 4 ..
+// max-threads (default 32): time per skin, vertices per second and speedup
+// over one thread. The kernel picked for this CPU is printed first.
+
+#include "SyntheticRig.h"
+
+#include <model/CpuSkinning.h>
+#include <model/ModelInstance.h>
+#include <model/WorkerPool.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+
+struct Options
+{
+	int nodes = 64;
+	int iterations = 20;
+	int max_threads = 32;
+
+	bool normals = true;
+
+}; // Options
+
+bool parse_args(int argc, char* argv[], Options& opts)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool has_val = i + 1 < argc;
+		if (strcmp(argv[i], "--nodes") == 0 && has_val) {
+			opts.nodes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--iterations") == 0 && has_val) {
+			opts.iterations = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--max-threads") == 0 && has_val) {
+			opts.max_threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--no-normals") == 0) {
+			opts.normals = false;
+		} else {
+			return false;
+		}
+	}
+	return opts.nodes > 0 && opts.iterations > 0 && opts.max_threads > 0;
+}
+
+// ms per skin
+double run(const model::MeshGeometry& geo, const sm::mat4* palette, sm::vec3* positions,
+	       sm::vec3* normals, model::WorkerPool& pool, int iterations)
+{
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		model::CpuSkinning::Skin(geo, palette, positions, normals, &pool);
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / iterations;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	if (!parse_args(argc, argv, opts))
+	{
+		fprintf(stderr, "usage: model_bench_skinning [--nodes N] [--iterations N] [--max-threads N] [--no-normals]\n");
+		return 2;
+	}
+
+	printf("kernel %s, %d nodes, %d iterations, %u hardware threads%s\n", model::CpuSkinning::GetKernelName(),
+		opts.nodes, opts.iterations, std::thread::hardware_concurrency(), opts.normals ? "" : ", no normals");
+	printf("%10s %8s %12s %14s %8s\n", "vertices", "threads", "ms/skin", "vertices/s", "speedup");
+
+	const int sizes[] = { 10000, 100000, 1000000 };
+	for (int n_vert : sizes)
+	{
+		synthetic::RigParams params;
+		params.nodes = opts.nodes;
+		params.vertices = n_vert;
+		auto model = synthetic::CreateRig(params);
+		const auto& geo = model->meshes[0]->geometry;
+
+		// a mid-clip pose, so every palette matrix differs from identity
+		model::ModelInstance inst(model, 0);
+		inst.SetStartTime(0);
+		inst.Update(params.duration * 0.5f);
+		std::vector<sm::mat4> palette(inst.GetPaletteSize());
+		inst.CalcPalettes(palette[0].x);
+
+		std::vector<sm::vec3> positions(geo.n_vert), normals(geo.n_vert);
+		sm::vec3* dst_nor = opts.normals ? normals.data() : nullptr;
+
+		double base_ms = 0;
+		for (int threads = 1; threads <= opts.max_threads; threads *= 2)
+		{
+			model::WorkerPool pool(threads);
+
+			// warm up caches and the pool's threads
+			run(geo, palette.data(), positions.data(), dst_nor, pool, 2);
+
+			const double ms = run(geo, palette.data(), positions.data(), dst_nor, pool, opts.iterations);
+			if (threads == 1) {
+				base_ms = ms;
+			}
+			printf("%10d %8d %12.3f %14.0f %8.2f\n", n_vert, threads, ms, n_vert * 1000.0 / ms, base_ms / ms);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// Procedural skinned model for the benchmarks and tests, built in memory
+// without files or a device.
+
+#include <model/Model.h>
+#include <model/SkeletalAnim.h>
+#include <model/typedef.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <string.h>
+
+namespace synthetic
+{
+
+struct RigParams
+{
+	// nodes in a tree, node i hangs under node (i - 1) / branching
+	int nodes = 64;
+	int branching = 3;
+
+	int clips = 2;
+	int keys_per_channel = 31;
+	float duration = 1.0f;
+
+	// of the single skinned mesh, every node is a bone, 0 for no mesh
+	int vertices = 0;
+	int weights_per_vertex = 4;
+
+}; // RigParams
+
+inline std::shared_ptr<model::Model> CreateRig(const RigParams& params)
+{
+	auto model = std::make_shared<model::Model>(nullptr);
+	auto sk = std::make_unique<model::SkeletalAnim>();
+
+	const int n_nodes = std::max(params.nodes, 1);
+	const int branching = std::max(params.branching, 1);
+
+	std::vector<std::unique_ptr<model::SkeletalAnim::Node>> nodes;
+	nodes.reserve(n_nodes);
+	for (int i = 0; i < n_nodes; ++i)
+	{
+		auto node = std::make_unique<model::SkeletalAnim::Node>();
+		node->name = "node" + std::to_string(i);
+		if (i > 0)
+		{
+			node->parent = (i - 1) / branching;
+			nodes[node->parent]->children.push_back(i);
+			node->local_trans.x[13] = 1.0f;
+		}
+		nodes.push_back(std::move(node));
+	}
+
+	// every node is a bone of mesh 0, its bind pose at the identity
+	if (params.vertices > 0)
+	{
+		nodes[0]->meshes.push_back(0);
+
+		auto mesh = std::make_unique<model::Model::Mesh>();
+		mesh->name = "skin";
+		auto& geo = mesh->geometry;
+		for (int i = 0; i < n_nodes; ++i)
+		{
+			model::Bone bone;
+			bone.node = i;
+			bone.name = nodes[i]->name;
+			bone.bound.Combine(sm::vec3(-1, -1, -1));
+			bone.bound.Combine(sm::vec3(1, 1, 1));
+			geo.bones.push_back(bone);
+		}
+
+		// pos3 normal3 indices u8x4 weights u8x4
+		const size_t stride = sizeof(float) * 6 + 8;
+		auto buf = new uint8_t[stride * params.vertices];
+		for (int i = 0; i < params.vertices; ++i)
+		{
+			uint8_t* ptr = buf + stride * i;
+			const float p[6] = { sinf(i * 0.37f), cosf(i * 0.11f), i * 0.001f, 0, 1, 0 };
+			memcpy(ptr, p, sizeof(p));
+
+			uint8_t indices[4] = { 0, 0, 0, 0 };
+			uint8_t weights[4] = { 0, 0, 0, 0 };
+			const int n_weights = std::min(std::max(params.weights_per_vertex, 1), 4);
+			for (int j = 0; j < n_weights; ++j)
+			{
+				indices[j] = static_cast<uint8_t>((i + j * 7) % std::min(n_nodes, 256));
+				weights[j] = static_cast<uint8_t>(255 / n_weights);
+			}
+			memcpy(ptr + sizeof(p), indices, 4);
+			memcpy(ptr + sizeof(p) + 4, weights, 4);
+		}
+		geo.vert_buf    = buf;
+		geo.vert_stride = stride;
+		geo.n_vert      = params.vertices;
+		geo.vertex_type = model::VERTEX_FLAG_NORMALS | model::VERTEX_FLAG_SKINNED;
+		geo.aabb.Combine(sm::vec3(-1, -1, -1));
+		geo.aabb.Combine(sm::vec3(1, 1 + n_nodes, 1));
+
+		model->meshes.push_back(std::move(mesh));
+	}
+
+	sk->SetNodes(nodes);
+
+	// every node swings around z, clips differ in amplitude
+	std::vector<std::unique_ptr<model::SkeletalAnim::ModelExtend>> anims;
+	for (int c = 0; c < params.clips; ++c)
+	{
+		auto anim = std::make_unique<model::SkeletalAnim::ModelExtend>();
+		anim->name = "clip" + std::to_string(c);
+		anim->duration = params.duration;
+		anim->ticks_per_second = (params.keys_per_channel - 1) / std::max(params.duration, 1e-3f);
+		for (int i = 0; i < n_nodes; ++i)
+		{
+			auto channel = std::make_shared<model::SkeletalAnim::NodeAnim>();
+			channel->name = "node" + std::to_string(i);
+			for (int k = 0; k < params.keys_per_channel; ++k)
+			{
+				const float t = params.duration * k / std::max(params.keys_per_channel - 1, 1);
+				const float a = 0.3f * (c + 1) * sinf(6.2831853f * t / params.duration + i);
+				channel->position_keys.push_back({ t, sm::vec3(0, i > 0 ? 1.0f : 0, 0) });
+				channel->rotation_keys.push_back({ t, sm::Quaternion(0, 0, sinf(a * 0.5f), cosf(a * 0.5f)) });
+			}
+			channel->scaling_keys.push_back({ 0, sm::vec3(1, 1, 1) });
+			anim->channels.push_back(channel);
+		}
+		anims.push_back(std::move(anim));
+	}
+	sk->SetAnims(anims);
+
+	model->ext = std::move(sk);
+	model->aabb.Combine(sm::vec3(-1, -1, -1));
+	model->aabb.Combine(sm::vec3(1, 1 + n_nodes, 1));
+
+	return model;
+}
+
+}
@@ -0,0 +1,568 @@
+// Batch converter of a source tree into CookedModel files, no device needed.
+//
+//   model_cooker <src_dir> <dst_dir> [-j threads] [--mem-mb budget]
+//                [--force] [--reduce-keys tolerance]
+//
+// <dst_dir>/<relative path>.cooked per input. Inputs whose content hash and
+// options match <dst_dir>/cook_manifest.txt, whose dependencies (OBJ
+// material libraries, glTF buffers and textures) are unchanged and whose
+// output exists are skipped. Textures inside <src_dir> are copied to the
+// same place under <dst_dir>, where the cooked files look for them.
+//
+// Formats without a CPU load stage (StagedModel::IsDeferred()) are listed
+// as unsupported; the exit status is 1 if any input failed or was
+// unsupported.
+
+#include <model/StagedModel.h>
+#include <model/CookedModel.h>
+#include <model/Model.h>
+#include <model/SkeletalAnim.h>
+#include <model/ModelExtendType.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+const char* MANIFEST_NAME = "cook_manifest.txt";
+
+// inputs, what Model::LoadFromFile() dispatches on: its own loaders, then
+// the assimp formats; the deferred ones are reported unsupported
+const char* MODEL_EXTS[] = {
+	".gltf", ".param", ".m3d", ".xml", ".mdl", ".bsp", ".map",
+	".fbx", ".obj", ".dae", ".3ds", ".x", ".ply", ".blend", ".ase",
+	".lwo", ".ms3d", ".md5mesh", ".stl", ".glb", ".b3d", ".ac",
+};
+
+// peak memory of a load relative to the input file, decoded meshes plus
+// the importer's own scene
+const uint64_t MEM_PER_INPUT_BYTE = 8;
+
+struct Options
+{
+	fs::path src_dir, dst_dir;
+
+	int   threads = 0;
+	int   mem_mb  = 2048;
+	bool  force   = false;
+
+	// 0 keeps all keys
+	float reduce_keys = 0;
+
+}; // Options
+
+struct Job
+{
+	fs::path src;
+	std::string rel;
+	uint64_t in_size = 0;
+	uint64_t hash = 0;
+
+	// files the output depends on besides src, with their combined hash
+	std::vector<std::string> deps;
+	uint64_t deps_hash = 0;
+
+	enum Status { SKIPPED, COOKED, FAILED, UNSUPPORTED } status = FAILED;
+	uint64_t out_size = 0;
+	// vertex and index bytes, see StagedModel::GetUploadStats(), textures
+	// aren't decoded here
+	uint64_t upload_size = 0;
+	double load_ms = 0, save_ms = 0;
+
+}; // Job
+
+// admits jobs while their estimates fit, one job always runs so a file
+// larger than the budget still gets cooked
+class MemoryBudget
+{
+public:
+	MemoryBudget(uint64_t limit) : m_limit(limit) {}
+
+	void Acquire(uint64_t size)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [&] { return m_used == 0 || m_used + size <= m_limit; });
+		m_used += size;
+	}
+
+	void Release(uint64_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_used -= size;
+		}
+		m_cv.notify_all();
+	}
+
+private:
+	uint64_t m_limit;
+	uint64_t m_used = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+
+}; // MemoryBudget
+
+// FNV-1a 64
+uint64_t hash_bytes(uint64_t h, const void* data, size_t size)
+{
+	auto p = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+// file content, format version and the options changing the output
+bool hash_file(const fs::path& path, const Options& opts, uint64_t& hash)
+{
+	std::ifstream fin(path, std::ios::binary);
+	if (!fin) {
+		return false;
+	}
+
+	uint64_t h = 0xcbf29ce484222325ull;
+	std::vector<char> buf(1 << 20);
+	while (fin)
+	{
+		fin.read(buf.data(), buf.size());
+		h = hash_bytes(h, buf.data(), static_cast<size_t>(fin.gcount()));
+	}
+
+	const uint32_t version = model::CookedModel::VERSION;
+	h = hash_bytes(h, &version, sizeof(version));
+	h = hash_bytes(h, &opts.reduce_keys, sizeof(opts.reduce_keys));
+
+	hash = h;
+	return true;
+}
+
+// contents of every dependency, missing ones by path only, so they change
+// the hash once they show up
+uint64_t hash_deps(const std::vector<std::string>& deps)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	std::vector<char> buf(1 << 20);
+	for (auto& dep : deps)
+	{
+		h = hash_bytes(h, dep.data(), dep.size());
+
+		std::ifstream fin(dep, std::ios::binary);
+		const uint8_t found = fin ? 1 : 0;
+		h = hash_bytes(h, &found, sizeof(found));
+		while (fin)
+		{
+			fin.read(buf.data(), buf.size());
+			h = hash_bytes(h, buf.data(), static_cast<size_t>(fin.gcount()));
+		}
+	}
+	return h;
+}
+
+// "mtllib" files of an OBJ, read by the importer but not kept in the model
+void add_obj_deps(const fs::path& path, std::vector<std::string>& deps)
+{
+	std::ifstream fin(path);
+	std::string line;
+	while (std::getline(fin, line))
+	{
+		if (line.compare(0, 7, "mtllib ") != 0) {
+			continue;
+		}
+		auto name = line.substr(7);
+		while (!name.empty() && isspace(static_cast<unsigned char>(name.back()))) {
+			name.pop_back();
+		}
+		if (!name.empty()) {
+			deps.push_back(fs::absolute(path.parent_path() / name).lexically_normal().generic_string());
+		}
+	}
+}
+
+// external "uri"s of a glTF, its buffers and images; data URIs are inline
+void add_gltf_deps(const fs::path& path, std::vector<std::string>& deps)
+{
+	std::ifstream fin(path);
+	const std::string json((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+	const std::string key = "\"uri\"";
+	for (size_t pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos))
+	{
+		pos += key.size();
+		while (pos < json.size() && (isspace(static_cast<unsigned char>(json[pos])) || json[pos] == ':')) {
+			++pos;
+		}
+		if (pos >= json.size() || json[pos] != '"') {
+			continue;
+		}
+		const size_t end = json.find('"', pos + 1);
+		if (end == std::string::npos) {
+			break;
+		}
+		auto uri = json.substr(pos + 1, end - pos - 1);
+		if (!uri.empty() && uri.compare(0, 5, "data:") != 0) {
+			deps.push_back(fs::absolute(path.parent_path() / uri).lexically_normal().generic_string());
+		}
+		pos = end + 1;
+	}
+}
+
+bool is_model_file(const fs::path& path)
+{
+	auto ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), tolower);
+	for (auto e : MODEL_EXTS) {
+		if (ext == e) {
+			return true;
+		}
+	}
+	return false;
+}
+
+struct ManifestEntry
+{
+	uint64_t hash = 0;
+	uint64_t deps_hash = 0;
+	std::vector<std::string> deps;
+
+}; // ManifestEntry
+
+// "<hash> <deps hash> <relative path>" per input, then "\t<dependency>"
+// per dependency
+std::map<std::string, ManifestEntry> load_manifest(const fs::path& path)
+{
+	std::map<std::string, ManifestEntry> ret;
+
+	std::ifstream fin(path);
+	std::string line;
+	ManifestEntry* entry = nullptr;
+	while (std::getline(fin, line))
+	{
+		if (!line.empty() && line[0] == '\t')
+		{
+			if (entry) {
+				entry->deps.push_back(line.substr(1));
+			}
+			continue;
+		}
+
+		entry = nullptr;
+		auto sp0 = line.find(' ');
+		auto sp1 = sp0 == std::string::npos ? sp0 : line.find(' ', sp0 + 1);
+		if (sp1 == std::string::npos) {
+			continue;
+		}
+		entry = &ret[line.substr(sp1 + 1)];
+		entry->hash      = strtoull(line.substr(0, sp0).c_str(), nullptr, 16);
+		entry->deps_hash = strtoull(line.substr(sp0 + 1, sp1 - sp0 - 1).c_str(), nullptr, 16);
+	}
+
+	return ret;
+}
+
+bool save_manifest(const fs::path& path, const std::vector<Job>& jobs)
+{
+	// replaced in one step, an interrupted run keeps the old manifest
+	auto tmp = path;
+	tmp += ".tmp";
+	{
+		std::ofstream fout(tmp);
+		for (auto& job : jobs) {
+			if (job.status != Job::COOKED && job.status != Job::SKIPPED) {
+				continue;
+			}
+			fout << std::hex << job.hash << ' ' << job.deps_hash << ' ' << job.rel << '\n';
+			for (auto& dep : job.deps) {
+				fout << '\t' << dep << '\n';
+			}
+		}
+		if (!fout) {
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	fs::rename(tmp, path, ec);
+	return !ec;
+}
+
+double ms_since(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// cooked files keep texture paths relative to the source file, see CookedModel
+void copy_textures(const model::Model& model, const Options& opts)
+{
+	// models sharing a texture are cooked in parallel
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const auto src_dir = fs::absolute(opts.src_dir).lexically_normal();
+	for (auto& tex : model.textures)
+	{
+		auto rel = fs::absolute(tex.first).lexically_normal().lexically_relative(src_dir);
+		if (rel.empty() || *rel.begin() == "..") {
+			fprintf(stderr, "texture outside %s: %s\n", opts.src_dir.string().c_str(), tex.first.c_str());
+			continue;
+		}
+
+		auto dst = opts.dst_dir / rel;
+		std::error_code ec;
+		fs::create_directories(dst.parent_path(), ec);
+		fs::copy_file(tex.first, dst, fs::copy_options::update_existing, ec);
+		if (ec) {
+			fprintf(stderr, "can't copy texture %s\n", tex.first.c_str());
+		}
+	}
+}
+
+void cook(Job& job, const Options& opts, const model::LoadOptions& load_opts)
+{
+	auto out = opts.dst_dir / job.rel;
+	out += ".cooked";
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	auto staged = model::StagedModel::Load(job.src.string(), load_opts);
+	job.load_ms = ms_since(t0);
+	if (!staged) {
+		job.status = Job::FAILED;
+		return;
+	}
+	if (staged->deferred) {
+		job.status = Job::UNSUPPORTED;
+		return;
+	}
+
+	auto upload = staged->GetUploadStats();
+	job.upload_size = upload.vertex_bytes + upload.index_bytes;
+
+	auto& model = *staged->model;
+	if (opts.reduce_keys > 0 && model.ext && model.ext->Type() == model::EXT_SKELETAL)
+	{
+		model::SkeletalAnim::CompressParams params;
+		params.pos_tolerance = params.rot_tolerance = params.scale_tolerance = opts.reduce_keys;
+		params.quantize = false;
+		static_cast<model::SkeletalAnim*>(model.ext.get())->CompressAnims(params);
+	}
+
+	auto t1 = std::chrono::steady_clock::now();
+
+	std::error_code ec;
+	fs::create_directories(out.parent_path(), ec);
+	if (!model::CookedModel::Save(*staged, out.string())) {
+		fs::remove(out, ec);
+		job.status = Job::FAILED;
+		return;
+	}
+	copy_textures(model, opts);
+	job.save_ms = ms_since(t1);
+
+	job.deps.clear();
+	auto ext = job.src.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), tolower);
+	if (ext == ".obj") {
+		add_obj_deps(job.src, job.deps);
+	} else if (ext == ".gltf") {
+		add_gltf_deps(job.src, job.deps);
+	}
+	for (auto& tex : model.textures) {
+		job.deps.push_back(fs::absolute(tex.first).lexically_normal().generic_string());
+	}
+	// a glTF lists its images as uris too
+	std::sort(job.deps.begin(), job.deps.end());
+	job.deps.erase(std::unique(job.deps.begin(), job.deps.end()), job.deps.end());
+	job.deps_hash = hash_deps(job.deps);
+
+	job.out_size = fs::file_size(out, ec);
+	job.status = Job::COOKED;
+}
+
+void report(const Job& job)
+{
+	static const char* STATUS[] = { "skip", "ok", "FAIL", "n/a" };
+	printf("%-4s %s  %" PRIu64 " -> %" PRIu64 " bytes  upload %" PRIu64 " bytes  load %.1f ms  save %.1f ms\n",
+		STATUS[job.status], job.rel.c_str(), job.in_size, job.out_size, job.upload_size, job.load_ms, job.save_ms);
+	fflush(stdout);
+}
+
+void usage()
+{
+	fprintf(stderr, "usage: model_cooker <src_dir> <dst_dir> [-j threads] [--mem-mb budget]\n"
+		            "                    [--force] [--reduce-keys tolerance]\n");
+}
+
+bool parse_args(int argc, char* argv[], Options& opts)
+{
+	std::vector<const char*> pos;
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool has_val = i + 1 < argc;
+		if (strcmp(argv[i], "-j") == 0 && has_val) {
+			opts.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--mem-mb") == 0 && has_val) {
+			opts.mem_mb = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--reduce-keys") == 0 && has_val) {
+			opts.reduce_keys = static_cast<float>(atof(argv[++i]));
+		} else if (strcmp(argv[i], "--force") == 0) {
+			opts.force = true;
+		} else if (argv[i][0] == '-') {
+			return false;
+		} else {
+			pos.push_back(argv[i]);
+		}
+	}
+	if (pos.size() != 2) {
+		return false;
+	}
+
+	opts.src_dir = pos[0];
+	opts.dst_dir = pos[1];
+	if (opts.threads <= 0) {
+		opts.threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	opts.mem_mb = std::max(1, opts.mem_mb);
+
+	return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	if (!parse_args(argc, argv, opts)) {
+		usage();
+		return 2;
+	}
+
+	std::error_code ec;
+	if (!fs::is_directory(opts.src_dir, ec)) {
+		fprintf(stderr, "not a directory: %s\n", opts.src_dir.string().c_str());
+		return 2;
+	}
+	fs::create_directories(opts.dst_dir, ec);
+
+	// only paths are cooked, textures are decoded when the cooked file loads
+	model::LoadOptions load_opts;
+	load_opts.decode_textures = false;
+	// files already spread over the cores
+	if (opts.threads > 1) {
+		load_opts.import_threads = 1;
+	}
+
+	std::vector<Job> jobs;
+	for (auto& entry : fs::recursive_directory_iterator(opts.src_dir, fs::directory_options::skip_permission_denied, ec))
+	{
+		if (!entry.is_regular_file() || !is_model_file(entry.path())) {
+			continue;
+		}
+		Job job;
+		job.src = entry.path();
+		job.rel = fs::relative(entry.path(), opts.src_dir).generic_string();
+		job.in_size = entry.file_size();
+		jobs.push_back(job);
+	}
+	// stable report and manifest order
+	std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) {
+		return a.rel < b.rel;
+	});
+
+	const auto manifest_path = opts.dst_dir / MANIFEST_NAME;
+	const auto manifest = opts.force ? std::map<std::string, ManifestEntry>() : load_manifest(manifest_path);
+
+	MemoryBudget budget(static_cast<uint64_t>(opts.mem_mb) << 20);
+	std::atomic<size_t> next(0);
+	std::mutex report_mutex;
+
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < jobs.size(); i = next++)
+		{
+			auto& job = jobs[i];
+			if (model::StagedModel::IsDeferred(job.src.string())) {
+				job.status = Job::UNSUPPORTED;
+			} else if (!hash_file(job.src, opts, job.hash)) {
+				job.status = Job::FAILED;
+			} else {
+				auto out = opts.dst_dir / job.rel;
+				out += ".cooked";
+
+				auto itr = manifest.find(job.rel);
+				if (itr != manifest.end() && itr->second.hash == job.hash && fs::exists(out)
+				 && hash_deps(itr->second.deps) == itr->second.deps_hash)
+				{
+					job.status = Job::SKIPPED;
+					job.deps = itr->second.deps;
+					job.deps_hash = itr->second.deps_hash;
+					std::error_code ec;
+					job.out_size = fs::file_size(out, ec);
+				}
+				else
+				{
+					const uint64_t mem = job.in_size * MEM_PER_INPUT_BYTE;
+					budget.Acquire(mem);
+					cook(job, opts, load_opts);
+					budget.Release(mem);
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(report_mutex);
+			report(job);
+		}
+	};
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	const int n_threads = std::min<int>(opts.threads, std::max<size_t>(1, jobs.size()));
+	std::vector<std::thread> threads;
+	for (int i = 1; i < n_threads; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	if (!save_manifest(manifest_path, jobs)) {
+		fprintf(stderr, "can't write %s\n", manifest_path.string().c_str());
+	}
+
+	int count[4] = { 0, 0, 0, 0 };
+	uint64_t in_total = 0, out_total = 0, upload_total = 0;
+	for (auto& job : jobs)
+	{
+		++count[job.status];
+		if (job.status == Job::COOKED) {
+			in_total  += job.in_size;
+			out_total += job.out_size;
+			upload_total += job.upload_size;
+		}
+	}
+	printf("%zu files: %d cooked, %d skipped, %d failed, %d unsupported; "
+		"cooked %" PRIu64 " -> %" PRIu64 " bytes, upload %" PRIu64 " bytes in %.1f s\n",
+		jobs.size(), count[Job::COOKED], count[Job::SKIPPED], count[Job::FAILED], count[Job::UNSUPPORTED],
+		in_total, out_total, upload_total, ms_since(t0) / 1000.0);
+
+	return count[Job::FAILED] == 0 && count[Job::UNSUPPORTED] == 0 ? 0 : 1;
+}